@@ -0,0 +1,376 @@
+// Micro-benchmarks for the casino tree. Build the projektas_bench target in
+// Release and run it; every case reports the best of several repetitions.
+//
+//   projektas_bench [gamesPerGroup [repetitions [breadth [depth]]]]
+//
+// Exits with 1 if TreeBuilder allocates more than its per-block budget.
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "casino.h"
+
+// Every global allocation is counted, so a case can report how many it made.
+static std::atomic<size_t> allocationCount{0};
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    auto alignment = static_cast<size_t>(align);
+    if (void* p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) return p;
+    throw std::bad_alloc();
+}
+
+// GCC pairs the inlined free() below with the caller's new expression and
+// cannot see that operator new is malloc() here too.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace {
+
+// Keeps results observable so the optimizer cannot drop the measured work.
+volatile std::int64_t sink = 0;
+
+struct TreeShape {
+    size_t breadth = 10;        // child groups per group
+    size_t depth = 3;           // levels of groups below the root
+    size_t gamesPerGroup = 1000; // games in every innermost group
+};
+
+void fill(Group& group, const TreeShape& shape, size_t level, size_t& serial) {
+    if (level == shape.depth) {
+        for (size_t i = 0; i < shape.gamesPerGroup; ++i, ++serial) {
+            group.add(std::make_unique<Game>("Game " + std::to_string(serial % 5000),
+                                             Money::fromUnits(Money::Raw(serial % 100000))));
+        }
+        return;
+    }
+    for (size_t i = 0; i < shape.breadth; ++i) {
+        auto child = std::make_unique<Group>("Group " + std::to_string(level) + "." + std::to_string(i));
+        fill(*child, shape, level + 1, serial);
+        group.add(std::move(child));
+    }
+}
+
+std::unique_ptr<Group> makeTree(const TreeShape& shape) {
+    auto root = std::make_unique<Group>("Casino Games");
+    size_t serial = 0;
+    fill(*root, shape, 0, serial);
+    return root;
+}
+
+void report(const std::string& name, size_t items, int repetitions, const std::function<void()>& body) {
+    double best = 1e300;
+    for (int r = 0; r < repetitions; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count());
+    }
+    std::cout << name << ": " << best * 1e3 << " ms";
+    if (items > 0) std::cout << " (" << best * 1e9 / double(items) << " ns/node)";
+    std::cout << '\n';
+}
+
+// Silences std::cout for functions that report their own progress.
+class QuietCout {
+private:
+    std::ostringstream discard;
+    std::streambuf* saved;
+public:
+    QuietCout() : saved(std::cout.rdbuf(discard.rdbuf())) {}
+    ~QuietCout() { std::cout.rdbuf(saved); }
+};
+
+void benchCore(const TreeShape& shape, int repetitions) {
+    auto tree = makeTree(shape);
+    size_t nodes = tree->getGameCount();
+    const std::string file = (std::filesystem::temp_directory_path() / "projektas_bench.txt").string();
+    std::cout << "== load, save, aggregate and update, " << nodes << " games ==\n";
+
+    report("saveToFile", nodes, repetitions, [&] {
+        QuietCout quiet;
+        saveToFile(tree.get(), file);
+    });
+    sink = sink + std::int64_t(std::filesystem::file_size(file));
+
+    report("loadFromFile", nodes, repetitions, [&] {
+        auto loaded = loadFromFile(file);
+        sink = sink + loaded->getRevenue().minorUnits();
+    });
+    report("loadFromFileMapped", nodes, repetitions, [&] {
+        auto loaded = loadFromFileMapped(file);
+        sink = sink + loaded->getRevenue().minorUnits();
+    });
+    report("loadFromFileParallel", nodes, repetitions, [&] {
+        auto loaded = loadFromFileParallel(file);
+        sink = sink + loaded->getRevenue().minorUnits();
+    });
+    report("loadFromFileLazy, open only", nodes, repetitions, [&] {
+        auto loaded = loadFromFileLazy(file);
+        sink = sink + std::int64_t(loaded->isGroup());
+    });
+    report("loadFromFileLazy, fully expanded", nodes, repetitions, [&] {
+        auto loaded = loadFromFileLazy(file);
+        sink = sink + loaded->getRevenue().minorUnits();
+    });
+
+    report("Group::getRevenue (cached)", 0, repetitions, [&] {
+        for (int i = 0; i < 1000; ++i) sink = sink + tree->getRevenue().minorUnits();
+    });
+    report("sumGames (full walk)", nodes, repetitions, [&] {
+        sink = sink + sumGames(tree.get()).minorUnits();
+    });
+    report("aggregateRevenue (parallel walk)", nodes, repetitions, [&] {
+        sink = sink + aggregateRevenue(*tree).minorUnits();
+    });
+    report("getAllGames", nodes, repetitions, [&] {
+        sink = sink + std::int64_t(tree->getAllGames().size());
+    });
+
+    auto games = tree->getAllGames();
+    report("Game::addRevenue", games.size(), repetitions, [&] {
+        for (Game* game : games) game->addRevenue(Money::fromUnits(1));
+    });
+
+    tree->enableIndex();
+    std::vector<RevenueEvent> events;
+    events.reserve(games.size());
+    for (Game* game : games) events.push_back({game->getParent()->getPath() + '/' + std::string(game->getName()), Money::fromUnits(1)});
+    report("ingestRevenue (batched by path)", events.size(), repetitions, [&] {
+        sink = sink + std::int64_t(ingestRevenue(*tree, events).applied);
+    });
+
+    std::filesystem::remove(file);
+}
+
+void benchVariant(const TreeShape& shape, int repetitions) {
+    auto tree = makeTree(shape);
+    size_t nodes = tree->getGameCount();
+    VariantNode variant = toVariant(tree.get());
+    std::cout << "== virtual hierarchy vs variant nodes, " << nodes << " games ==\n";
+
+    report("sum, virtual Component", nodes, repetitions, [&] {
+        sink = sink + sumGames(tree.get()).minorUnits();
+    });
+    report("sum, variant", nodes, repetitions, [&] {
+        sink = sink + variantRevenue(variant).minorUnits();
+    });
+    report("save, virtual Component", nodes, repetitions, [&] {
+        std::ostringstream out;
+        TextWriter writer(out);
+        tree->save(writer);
+        writer.flush();
+        sink = sink + std::int64_t(out.tellp());
+    });
+    report("save, variant", nodes, repetitions, [&] {
+        std::ostringstream out;
+        TextWriter writer(out);
+        variantSave(variant, writer);
+        writer.flush();
+        sink = sink + std::int64_t(out.tellp());
+    });
+}
+
+// Adds one unit to `games` round-robin from `threads` threads at once.
+void addFromThreads(const std::vector<Game*>& games, unsigned threads, size_t perThread) {
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            for (size_t i = 0; i < perThread; ++i) games[(i * threads + t) % games.size()]->addRevenue(Money::fromUnits(1));
+        });
+    }
+    for (auto& th : pool) th.join();
+}
+
+unsigned benchThreads() { return std::max(2u, std::min(8u, std::thread::hardware_concurrency())); }
+
+// Game::addRevenue from several threads at once, with and without history.
+// With it, every event updates the root's history too. The tree is small
+// because each node's history holds 3,600 buckets.
+void benchHistory(int repetitions) {
+    TreeShape shape;
+    shape.breadth = 10;
+    shape.depth = 1;
+    shape.gamesPerGroup = 100;
+    auto tree = makeTree(shape);
+    auto games = tree->getAllGames();
+    unsigned threads = benchThreads();
+    size_t perThread = 200000;
+    auto hammer = [&] { addFromThreads(games, threads, perThread); };
+    std::cout << "== revenue history, " << threads << " threads adding revenue ==\n";
+
+    report("addRevenue, no history", threads * perThread, repetitions, hammer);
+    tree->enableHistory();
+    report("addRevenue, history on every node", threads * perThread, repetitions, hammer);
+    report("revenueInLast(24h) at the root", 0, repetitions, [&] {
+        sink = sink + tree->revenueInLast(std::chrono::hours(24)).minorUnits();
+    });
+}
+
+// The same with a maintained ranking, which every event repositions, and
+// the queries it serves.
+void benchRanking(const TreeShape& shape, int repetitions) {
+    auto tree = makeTree(shape);
+    auto games = tree->getAllGames();
+    unsigned threads = benchThreads();
+    size_t perThread = 200000;
+    auto hammer = [&] { addFromThreads(games, threads, perThread); };
+    std::cout << "== ranking, " << games.size() << " games, " << threads << " threads adding revenue ==\n";
+
+    report("addRevenue, no ranking", threads * perThread, repetitions, hammer);
+    report("enableRanking", games.size(), 1, [&] { sink = sink + std::int64_t(tree->enableRanking()->size()); });
+    report("addRevenue, ranked", threads * perThread, repetitions, hammer);
+    report("GameRanking::top(10)", 0, repetitions, [&] {
+        sink = sink + std::int64_t(tree->getRanking()->top(10).size());
+    });
+    report("topK(10) without a ranking (full walk)", games.size(), repetitions, [&] {
+        sink = sink + std::int64_t(topK(*tree, 10).size());
+    });
+}
+
+// Revenue into one flat group of 100k games, live tree against versions.
+// Small versions stand for the server, which publishes once per wakeup.
+void benchVersions(int repetitions) {
+    constexpr size_t gameCount = 100000;
+    constexpr size_t eventCount = 10000;
+    auto root = std::make_unique<Group>("Casino Games");
+    auto flat = std::make_unique<Group>("Slots");
+    for (size_t i = 0; i < gameCount; ++i) flat->add(std::make_unique<Game>("Game " + std::to_string(i), Money()));
+    root->add(std::move(flat));
+    root->enableIndex();
+    VersionedTree versions(*root);
+    std::vector<RevenueEvent> events;
+    for (size_t i = 0; i < eventCount; ++i)
+        events.push_back({"Casino Games/Slots/Game " + std::to_string(i * 7919 % gameCount), Money::fromUnits(1)});
+    std::cout << "== versioned snapshots, " << gameCount << " games in one group ==\n";
+
+    report("ingestRevenue", events.size(), repetitions, [&] {
+        sink = sink + std::int64_t(ingestRevenue(*root, events).applied);
+    });
+    report("VersionedTree::apply, one version", events.size(), repetitions, [&] {
+        sink = sink + std::int64_t(versions.apply(events).applied);
+    });
+    report("VersionedTree::apply, a version per 100 events", events.size(), repetitions, [&] {
+        std::span<const RevenueEvent> all(events);
+        for (size_t at = 0; at < all.size(); at += 100)
+            sink = sink + std::int64_t(versions.apply(all.subspan(at, std::min<size_t>(100, all.size() - at))).applied);
+    });
+    report("pinned report (total per child)", gameCount, repetitions, [&] {
+        VersionedTree::Version version = versions.pin();
+        const VersionNode* slots = version.root->find("Casino Games/Slots", true);
+        for (const VersionPtr& game : slots->children) sink = sink + game->getRevenue().minorUnits();
+    });
+}
+
+// The same tree as makeTree(), through TreeBuilder with every child count
+// known up front. Names come from `names` so building itself makes no
+// strings.
+struct BuilderNames {
+    std::vector<std::string> games;
+    std::vector<std::vector<std::string>> groups; // [level][i]
+
+    explicit BuilderNames(const TreeShape& shape) : groups(shape.depth) {
+        for (size_t i = 0; i < 5000; ++i) games.push_back("Game " + std::to_string(i));
+        for (size_t level = 0; level < shape.depth; ++level)
+            for (size_t i = 0; i < shape.breadth; ++i)
+                groups[level].push_back("Group " + std::to_string(level) + "." + std::to_string(i));
+    }
+};
+
+void build(TreeBuilder& builder, const TreeShape& shape, const BuilderNames& names, size_t level, size_t& serial) {
+    if (level == shape.depth) {
+        for (size_t i = 0; i < shape.gamesPerGroup; ++i, ++serial)
+            builder.addGame(names.games[serial % 5000], Money::fromUnits(Money::Raw(serial % 100000)));
+        return;
+    }
+    for (size_t i = 0; i < shape.breadth; ++i) {
+        builder.openGroup(names.groups[level][i], level + 1 == shape.depth ? shape.gamesPerGroup : shape.breadth);
+        build(builder, shape, names, level + 1, serial);
+        builder.closeGroup();
+    }
+}
+
+std::unique_ptr<Group> buildTree(const TreeShape& shape, const BuilderNames& names) {
+    TreeBuilder builder("Casino Games", shape.depth ? shape.breadth : shape.gamesPerGroup);
+    size_t serial = 0;
+    build(builder, shape, names, 0, serial);
+    return builder.finish();
+}
+
+template <class Build>
+size_t countAllocations(Build&& body) {
+    size_t before = allocationCount.load();
+    body();
+    return allocationCount.load() - before;
+}
+
+// Allocations while building, after a first build has interned every name.
+// Returns false if TreeBuilder needs more than one allocation per 64 nodes,
+// i.e. it is no longer allocating per arena block.
+bool benchBuilder(const TreeShape& shape, int repetitions) {
+    BuilderNames names(shape);
+    buildTree(shape, names); // interns the names
+    std::unique_ptr<Group> tree;
+    size_t built = countAllocations([&] { tree = buildTree(shape, names); });
+    size_t nodes = tree->getGameCount();
+    tree.reset();
+    std::unique_ptr<Group> classic;
+    size_t added = countAllocations([&] { classic = makeTree(shape); });
+    std::cout << "== tree building, " << nodes << " games ==\n";
+    std::cout << "allocations, TreeBuilder: " << built << " (" << double(built) / double(nodes) << " per game)\n";
+    std::cout << "allocations, Group::add(make_unique): " << added << " (" << double(added) / double(nodes)
+              << " per game)\n";
+
+    report("build, TreeBuilder", nodes, repetitions, [&] {
+        auto t = buildTree(shape, names);
+        sink = sink + t->getRevenue().minorUnits();
+    });
+    report("build, Group::add(make_unique)", nodes, repetitions, [&] {
+        auto t = makeTree(shape);
+        sink = sink + t->getRevenue().minorUnits();
+    });
+    return built * 64 <= nodes;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    TreeShape shape;
+    int repetitions = 5;
+    if (argc > 1) shape.gamesPerGroup = std::strtoul(argv[1], nullptr, 10);
+    if (argc > 2) repetitions = std::atoi(argv[2]);
+    if (argc > 3) shape.breadth = std::strtoul(argv[3], nullptr, 10);
+    if (argc > 4) shape.depth = std::strtoul(argv[4], nullptr, 10);
+
+    benchCore(shape, repetitions);
+    benchVariant(shape, repetitions);
+    benchVersions(repetitions);
+    benchHistory(repetitions);
+    benchRanking(shape, repetitions);
+    if (!benchBuilder(shape, repetitions)) {
+        std::cerr << "TreeBuilder allocated per node\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,3703 @@
+#ifndef PROJEKTAS_CASINO_H
+#define PROJEKTAS_CASINO_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <charconv>
+#include <system_error>
+#include <cstring>
+#include <algorithm>
+#include <span>
+#include <set>
+#include <atomic>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <memory_resource>
+#include <new>
+#include <variant>
+#include <type_traits>
+#include <filesystem>
+#include <random>
+#include <chrono>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#ifndef CASINO_ZLIB
+#define CASINO_ZLIB 0
+#endif
+#if CASINO_ZLIB
+#include <zlib.h>
+#endif
+
+// === MONEY ===
+#ifndef CASINO_MONEY_DIGITS
+#define CASINO_MONEY_DIGITS 2
+#endif
+
+// Fixed-point amount counted in minor units (cents unless
+// CASINO_MONEY_DIGITS says otherwise). Integer sums are exact, so totals do
+// not drift and do not depend on the order games are added up in.
+class Money {
+public:
+    using Raw = std::int64_t;
+    static constexpr int digits = CASINO_MONEY_DIGITS;
+    static constexpr Raw scale = [] {
+        Raw s = 1;
+        for (int i = 0; i < digits; ++i) s *= 10;
+        return s;
+    }();
+
+private:
+    Raw units = 0;
+
+public:
+    constexpr Money() = default;
+    static constexpr Money fromUnits(Raw u) {
+        Money m;
+        m.units = u;
+        return m;
+    }
+    static Money fromDouble(double value) { return fromUnits(std::llround(value * double(scale))); }
+
+    constexpr Raw minorUnits() const { return units; }
+    double toDouble() const { return double(units) / double(scale); }
+
+    constexpr Money& operator+=(Money other) { units += other.units; return *this; }
+    constexpr Money& operator-=(Money other) { units -= other.units; return *this; }
+    friend constexpr Money operator+(Money a, Money b) { return a += b; }
+    friend constexpr Money operator-(Money a, Money b) { return a -= b; }
+    friend constexpr Money operator-(Money a) { return fromUnits(-a.units); }
+    friend constexpr auto operator<=>(Money, Money) = default;
+
+    // "[+-]digits[.digits]", rounding extra fraction digits half away from
+    // zero. Anything else that reads, as a whole, as a finite number (old
+    // saves wrote e.g. "1.23457e+06") is accepted through a double and
+    // rounded; trailing junk such as "5xyz" is rejected.
+    static bool parse(std::string_view text, Money& out) {
+        bool negative = false;
+        size_t i = 0;
+        if (i < text.size() && (text[i] == '+' || text[i] == '-')) negative = text[i++] == '-';
+        Raw whole = 0;
+        Raw fraction = 0;
+        size_t wholeDigits = 0;
+        size_t fractionDigits = 0;
+        bool roundUp = false;
+        bool exact = true;
+        for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i, ++wholeDigits) {
+            if (whole > (std::numeric_limits<Raw>::max() / scale - 9) / 10) exact = false;
+            whole = whole * 10 + (text[i] - '0');
+        }
+        if (i < text.size() && text[i] == '.') {
+            for (++i; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i, ++fractionDigits) {
+                if (fractionDigits < size_t(digits)) fraction = fraction * 10 + (text[i] - '0');
+                else if (fractionDigits == size_t(digits)) roundUp = text[i] >= '5';
+            }
+        }
+        if (exact && i == text.size() && wholeDigits + fractionDigits > 0) {
+            for (size_t d = fractionDigits; d < size_t(digits); ++d) fraction *= 10;
+            Raw u = whole * scale + fraction + (roundUp ? 1 : 0);
+            out = fromUnits(negative ? -u : u);
+            return true;
+        }
+
+        double value;
+        const char* first = text.data() + (text.substr(0, 1) == "+" ? 1 : 0);
+        const char* last = text.data() + text.size();
+        auto [ptr, ec] = std::from_chars(first, last, value);
+        if (ec != std::errc() || ptr != last || !std::isfinite(value)) return false;
+        if (std::fabs(value) * double(scale) >= 9.2e18) return false;
+        out = fromDouble(value);
+        return true;
+    }
+
+    // Shortest exact text: "12", "12.5", "-0.05".
+    size_t format(char* buffer) const {
+        char* p = buffer;
+        std::uint64_t magnitude = units < 0 ? 0 - std::uint64_t(units) : std::uint64_t(units);
+        if (units < 0) *p++ = '-';
+        p = std::to_chars(p, p + 24, magnitude / std::uint64_t(scale)).ptr;
+        std::uint64_t fraction = magnitude % std::uint64_t(scale);
+        if (fraction != 0) {
+            char digitsBuf[digits > 0 ? digits : 1];
+            for (int d = digits - 1; d >= 0; --d) {
+                digitsBuf[d] = char('0' + fraction % 10);
+                fraction /= 10;
+            }
+            int used = digits;
+            while (used > 0 && digitsBuf[used - 1] == '0') used--;
+            *p++ = '.';
+            for (int d = 0; d < used; ++d) *p++ = digitsBuf[d];
+        }
+        return size_t(p - buffer);
+    }
+
+    static constexpr size_t maxFormatted = 48;
+
+    std::string toString() const {
+        char buffer[maxFormatted];
+        return std::string(buffer, format(buffer));
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, Money amount) {
+    return out << amount.toString();
+}
+
+// === OUTPUT ===
+// Formats into one reusable buffer and hands it to the stream in large
+// blocks. Lines end with a plain '\n'; nothing is flushed until the buffer
+// fills up, flush() is called or the writer goes out of scope.
+class TextWriter {
+private:
+    static constexpr size_t blockSize = 1 << 16;
+    static constexpr std::string_view padding =
+        "                                                                "
+        "                                                                ";
+
+    std::ostream& out;
+    std::string buffer;
+
+    void reserve(size_t n) {
+        if (buffer.size() + n > blockSize) flush();
+    }
+
+public:
+    explicit TextWriter(std::ostream& o) : out(o) { buffer.reserve(blockSize); }
+    ~TextWriter() { flush(); }
+
+    TextWriter(const TextWriter&) = delete;
+    TextWriter& operator=(const TextWriter&) = delete;
+
+    // Two spaces per level, copied from a fixed padding string.
+    TextWriter& indent(int levels) {
+        size_t n = levels > 0 ? static_cast<size_t>(levels) * 2 : 0;
+        while (n > 0) {
+            size_t chunk = std::min(n, padding.size());
+            *this << padding.substr(0, chunk);
+            n -= chunk;
+        }
+        return *this;
+    }
+
+    TextWriter& operator<<(std::string_view s) {
+        reserve(s.size());
+        if (s.size() >= blockSize) out.write(s.data(), static_cast<std::streamsize>(s.size()));
+        else buffer.append(s);
+        return *this;
+    }
+
+    TextWriter& operator<<(char c) {
+        reserve(1);
+        buffer.push_back(c);
+        return *this;
+    }
+
+    TextWriter& operator<<(Money amount) {
+        char digits[Money::maxFormatted];
+        return *this << std::string_view(digits, amount.format(digits));
+    }
+
+    // Same text as `std::ostream << double` with default flags ("%g").
+    TextWriter& operator<<(double value) {
+        char digits[32];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6);
+        return *this << std::string_view(digits, static_cast<size_t>(result.ptr - digits));
+    }
+
+    void flush() {
+        if (buffer.empty()) return;
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+};
+
+// === CONCURRENT ACCUMULATORS ===
+// Revenue total split over cache-line sized shards. Every thread adds to its
+// own shard (lock-free, no shared line to fight over) and readers sum the
+// shards, so a busy group total never becomes a contention point.
+class ShardedCounter {
+private:
+    static constexpr size_t shardCount = 8;
+
+    struct alignas(64) Shard {
+        std::atomic<Money::Raw> value{0};
+    };
+    std::array<Shard, shardCount> shards;
+
+    static size_t shardIndex() {
+        static std::atomic<size_t> nextThread{0};
+        thread_local size_t mine = nextThread.fetch_add(1, std::memory_order_relaxed) % shardCount;
+        return mine;
+    }
+
+public:
+    void add(Money delta) {
+        shards[shardIndex()].value.fetch_add(delta.minorUnits(), std::memory_order_relaxed);
+    }
+
+    Money load() const {
+        Money::Raw sum = 0;
+        for (const auto& shard : shards) sum += shard.value.load(std::memory_order_relaxed);
+        return Money::fromUnits(sum);
+    }
+};
+
+// === REVENUE HISTORY ===
+// When revenue came in: per-minute sums for the last 24 hours and per-hour
+// sums for the last 90 days, each in a ring of fixed buckets. Recording is
+// lock-free and safe from many threads, so a root's history does not
+// serialize ingestion; a query costs O(buckets in the window) however many
+// events were recorded.
+class RevenueHistory {
+public:
+    using Clock = std::chrono::system_clock;
+    static constexpr size_t minuteBuckets = 24 * 60;
+    static constexpr size_t hourBuckets = 90 * 24;
+
+private:
+    // Each slot is tagged with the bucket it holds. A slot still tagged with
+    // an older bucket reads as empty and is reset by the first add() of its
+    // new one; the resetting thread holds the slot for that moment only, and
+    // every other add is a relaxed atomic add.
+    struct Ring {
+        static constexpr std::int64_t unset = std::numeric_limits<std::int64_t>::min();
+        static constexpr std::int64_t resetting = unset + 1;
+
+        struct Slot {
+            std::atomic<std::int64_t> bucket{unset};
+            std::atomic<Money::Raw> sum{0};
+        };
+
+        std::unique_ptr<Slot[]> slots;
+        std::int64_t count;
+
+        explicit Ring(size_t buckets) : slots(std::make_unique<Slot[]>(buckets)), count(std::int64_t(buckets)) {}
+
+        Slot& slot(std::int64_t bucket) const { return slots[size_t((bucket % count + count) % count)]; }
+
+        void add(std::int64_t bucket, Money::Raw units) {
+            Slot& s = slot(bucket);
+            std::int64_t held = s.bucket.load(std::memory_order_acquire);
+            while (held != bucket) {
+                if (held == resetting) {
+                    std::this_thread::yield();
+                    held = s.bucket.load(std::memory_order_acquire);
+                } else if (held > bucket) {
+                    return; // older than anything the ring still holds
+                } else if (s.bucket.compare_exchange_weak(held, resetting, std::memory_order_acquire)) {
+                    s.sum.store(0, std::memory_order_relaxed);
+                    s.bucket.store(bucket, std::memory_order_release);
+                    held = bucket;
+                }
+            }
+            s.sum.fetch_add(units, std::memory_order_relaxed);
+        }
+
+        Money::Raw sum(std::int64_t first, std::int64_t last) const {
+            first = std::max(first, last - count + 1);
+            Money::Raw total = 0;
+            for (std::int64_t b = first; b <= last; ++b) {
+                const Slot& s = slot(b);
+                if (s.bucket.load(std::memory_order_acquire) == b) total += s.sum.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+    };
+
+    Ring minutes{minuteBuckets};
+    Ring hours{hourBuckets};
+
+    static std::int64_t minuteOf(Clock::time_point t) {
+        return std::chrono::floor<std::chrono::minutes>(t.time_since_epoch()).count();
+    }
+
+public:
+    void record(Money amount, Clock::time_point at) {
+        std::int64_t minute = minuteOf(at);
+        minutes.add(minute, amount.minorUnits());
+        hours.add(minute >= 0 ? minute / 60 : (minute - 59) / 60, amount.minorUnits());
+    }
+
+    // Revenue recorded in the `window` ending with the minute that contains
+    // `now`. Windows up to 24 hours are summed from minute buckets, longer
+    // ones from hour buckets and so are rounded up to whole hours.
+    Money window(std::chrono::minutes window, Clock::time_point now = Clock::now()) const {
+        std::int64_t minute = minuteOf(now);
+        std::int64_t span = window.count();
+        if (span <= 0) return Money();
+        if (span <= std::int64_t(minuteBuckets)) return Money::fromUnits(minutes.sum(minute - span + 1, minute));
+        std::int64_t hour = minute >= 0 ? minute / 60 : (minute - 59) / 60;
+        std::int64_t spanHours = (span + 59) / 60;
+        return Money::fromUnits(hours.sum(hour - spanHours + 1, hour));
+    }
+};
+
+// === METRICS ===
+// Per-operation call counts and latency histograms, plus a few item
+// counters. Every thread writes to its own block (relaxed atomics, no
+// sharing); a block is folded into a process-wide total when its thread
+// exits, and writePrometheus() sums the live blocks with that total.
+// Instrumentation goes through CASINO_TIMED / CASINO_COUNT, which compile to
+// nothing unless CASINO_METRICS is set (the CMake option of the same name).
+#ifndef CASINO_METRICS
+#define CASINO_METRICS 0
+#endif
+
+class Metrics {
+public:
+    enum class Op { Load, Parse, Save, JournalAppend, GetRevenue, AddRevenue, BatchCommit, Count };
+    enum class Counter { NodesParsed, RevenueEvents, Count };
+
+    static constexpr size_t opCount = size_t(Op::Count);
+    static constexpr size_t counterCount = size_t(Counter::Count);
+    // Bucket b counts calls that took less than 2^(b + 6) ns (64 ns up to
+    // about 0.5 s); the last one is unbounded.
+    static constexpr size_t bucketCount = 24;
+
+private:
+    static constexpr std::array<std::string_view, opCount> opNames{
+        "load", "parse", "save", "journal_append", "get_revenue", "add_revenue", "batch_commit"};
+    static constexpr std::array<std::string_view, counterCount> counterNames{
+        "casino_nodes_parsed_total", "casino_revenue_events_total"};
+
+    struct Block {
+        std::array<std::atomic<std::uint64_t>, opCount> calls{};
+        std::array<std::atomic<std::uint64_t>, opCount> nanos{};
+        std::array<std::array<std::atomic<std::uint64_t>, bucketCount>, opCount> buckets{};
+        std::array<std::atomic<std::uint64_t>, counterCount> counters{};
+
+        // Only the owning thread writes, so a plain load + store is enough.
+        static void bump(std::atomic<std::uint64_t>& a, std::uint64_t n) {
+            a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        void addTo(Block& into) const {
+            for (size_t op = 0; op < opCount; ++op) {
+                bump(into.calls[op], calls[op].load(std::memory_order_relaxed));
+                bump(into.nanos[op], nanos[op].load(std::memory_order_relaxed));
+                for (size_t b = 0; b < bucketCount; ++b) {
+                    bump(into.buckets[op][b], buckets[op][b].load(std::memory_order_relaxed));
+                }
+            }
+            for (size_t c = 0; c < counterCount; ++c) bump(into.counters[c], counters[c].load(std::memory_order_relaxed));
+        }
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<Block*> live;
+        Block retired; // written under the mutex only
+    };
+
+    // Never destroyed: threads may still retire their blocks during exit.
+    static Registry& registry() {
+        static Registry* r = new Registry;
+        return *r;
+    }
+
+    struct Registration {
+        Block block;
+        Registration() {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            registry().live.push_back(&block);
+        }
+        ~Registration() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            block.addTo(r.retired);
+            r.live.erase(std::find(r.live.begin(), r.live.end(), &block));
+        }
+    };
+
+    static Block& local() {
+        thread_local Registration mine;
+        return mine.block;
+    }
+
+public:
+    static void record(Op op, std::uint64_t nanos) {
+        Block& b = local();
+        size_t i = size_t(op);
+        size_t bucket = 0;
+        while (bucket + 1 < bucketCount && nanos >= (std::uint64_t(64) << bucket)) bucket++;
+        Block::bump(b.calls[i], 1);
+        Block::bump(b.nanos[i], nanos);
+        Block::bump(b.buckets[i][bucket], 1);
+    }
+
+    static void count(Counter counter, std::uint64_t n) { Block::bump(local().counters[size_t(counter)], n); }
+
+    // Prometheus text exposition format.
+    static void writePrometheus(std::ostream& out) {
+        if (!CASINO_METRICS) {
+            out << "# metrics are compiled out; configure with -DCASINO_METRICS=ON\n";
+            return;
+        }
+        Block total;
+        {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.retired.addTo(total);
+            for (const Block* b : r.live) b->addTo(total);
+        }
+
+        out << "# HELP casino_operation_seconds Latency of instrumented casino operations.\n"
+            << "# TYPE casino_operation_seconds histogram\n";
+        for (size_t op = 0; op < opCount; ++op) {
+            std::uint64_t cumulative = 0;
+            for (size_t b = 0; b < bucketCount; ++b) {
+                cumulative += total.buckets[op][b].load(std::memory_order_relaxed);
+                out << "casino_operation_seconds_bucket{op=\"" << opNames[op] << "\",le=\"";
+                if (b + 1 < bucketCount) out << double(std::uint64_t(64) << b) * 1e-9;
+                else out << "+Inf";
+                out << "\"} " << cumulative << '\n';
+            }
+            out << "casino_operation_seconds_sum{op=\"" << opNames[op] << "\"} "
+                << double(total.nanos[op].load(std::memory_order_relaxed)) * 1e-9 << '\n'
+                << "casino_operation_seconds_count{op=\"" << opNames[op] << "\"} "
+                << total.calls[op].load(std::memory_order_relaxed) << '\n';
+        }
+        for (size_t c = 0; c < counterCount; ++c) {
+            out << "# TYPE " << counterNames[c] << " counter\n"
+                << counterNames[c] << ' ' << total.counters[c].load(std::memory_order_relaxed) << '\n';
+        }
+    }
+};
+
+// Records the lifetime of the enclosing scope under one operation.
+class ScopedTimer {
+private:
+    Metrics::Op op;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+public:
+    explicit ScopedTimer(Metrics::Op o) : op(o) {}
+    ~ScopedTimer() {
+        auto took = std::chrono::steady_clock::now() - start;
+        Metrics::record(op, std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(took).count()));
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+#if CASINO_METRICS
+#define CASINO_TIMED(op) ScopedTimer casinoScopedTimer(Metrics::Op::op)
+#define CASINO_COUNT(counter, n) Metrics::count(Metrics::Counter::counter, (n))
+#else
+#define CASINO_TIMED(op) ((void)0)
+#define CASINO_COUNT(counter, n) ((void)0)
+#endif
+
+// === NAMES ===
+// Process-wide table of interned names. Every distinct string is stored once
+// in chunked character blocks and never moves or dies, so handles stay valid
+// for the life of the process. Interning locks one of several shards picked
+// by the string's hash, so threads loading different names rarely wait on
+// each other; reading a handle back is lock-free.
+class NameTable {
+private:
+    static constexpr size_t chunkBits = 16;
+    static constexpr size_t chunkSize = size_t(1) << chunkBits;
+    static constexpr size_t maxChunks = size_t(1) << 14;
+    static constexpr size_t blockSize = size_t(1) << 16;
+    static constexpr size_t shardCount = 16;
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string_view, std::uint32_t> lookup;
+        std::vector<std::unique_ptr<char[]>> blocks;
+        size_t blockUsed = blockSize;
+
+        std::string_view store(std::string_view s) {
+            if (s.size() > blockSize / 4) {
+                blocks.push_back(std::make_unique<char[]>(s.size()));
+                std::memcpy(blocks.back().get(), s.data(), s.size());
+                return {blocks.back().get(), s.size()};
+            }
+            if (blockUsed + s.size() > blockSize) {
+                // Keep the partly used block at the back for small strings.
+                blocks.push_back(std::make_unique<char[]>(blockSize));
+                blockUsed = 0;
+            }
+            char* at = blocks.back().get() + blockUsed;
+            std::memcpy(at, s.data(), s.size());
+            blockUsed += s.size();
+            return {at, s.size()};
+        }
+    };
+
+    std::array<Shard, shardCount> shards;
+    std::atomic<std::uint32_t> count{0};
+    std::array<std::atomic<std::string_view*>, maxChunks> chunks{};
+
+    Shard& shardFor(std::string_view s) {
+        return shards[std::hash<std::string_view>{}(s) % shardCount];
+    }
+
+    std::string_view* slotsFor(std::uint32_t id) {
+        std::atomic<std::string_view*>& chunk = chunks[id >> chunkBits];
+        std::string_view* slots = chunk.load(std::memory_order_acquire);
+        if (slots) return slots;
+        auto* fresh = new std::string_view[chunkSize];
+        if (chunk.compare_exchange_strong(slots, fresh, std::memory_order_acq_rel)) return fresh;
+        delete[] fresh; // another shard published this chunk first
+        return slots;
+    }
+
+    NameTable() { intern(""); }
+
+public:
+    NameTable(const NameTable&) = delete;
+    NameTable& operator=(const NameTable&) = delete;
+
+    static NameTable& instance() {
+        static NameTable table;
+        return table;
+    }
+
+    std::uint32_t intern(std::string_view s) {
+        Shard& shard = shardFor(s);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.lookup.find(s);
+        if (it != shard.lookup.end()) return it->second;
+
+        std::uint32_t id = count.fetch_add(1, std::memory_order_relaxed);
+        std::string_view stored = s.empty() ? std::string_view() : shard.store(s);
+        slotsFor(id)[id & (chunkSize - 1)] = stored;
+        shard.lookup.emplace(stored, id);
+        return id;
+    }
+
+    // Handle of an already interned name, without adding it.
+    bool find(std::string_view s, std::uint32_t& id) {
+        Shard& shard = shardFor(s);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.lookup.find(s);
+        if (it == shard.lookup.end()) return false;
+        id = it->second;
+        return true;
+    }
+
+    std::string_view get(std::uint32_t id) const {
+        return chunks[id >> chunkBits].load(std::memory_order_acquire)[id & (chunkSize - 1)];
+    }
+};
+
+// 4-byte handle to an interned name. Equal names have equal handles.
+class Name {
+private:
+    std::uint32_t id = 0; // 0 is the empty name
+public:
+    Name() = default;
+    explicit Name(std::string_view s) : id(NameTable::instance().intern(s)) {}
+
+    static Name fromHandle(std::uint32_t handle) {
+        Name n;
+        n.id = handle;
+        return n;
+    }
+
+    // Looks a name up without interning it; false if no node ever used it.
+    static bool find(std::string_view s, Name& out) { return NameTable::instance().find(s, out.id); }
+
+    std::uint32_t handle() const { return id; }
+    std::string_view view() const { return NameTable::instance().get(id); }
+    bool empty() const { return id == 0; }
+    bool operator==(const Name&) const = default;
+};
+
+// Whether `n` survives a text save and load: not blank and on one line.
+// A blank name would be dropped on load and shift every later sibling's
+// position, so nodes with one are never added to a tree.
+inline bool isStorableName(std::string_view n) {
+    return n.find_first_of("\r\n") == std::string_view::npos && n.find_first_not_of(" \t\v\f") != std::string_view::npos;
+}
+
+struct NameHash {
+    size_t operator()(Name n) const { return std::hash<std::uint32_t>{}(n.handle()); }
+};
+
+class Group;
+
+// === COMPONENT INTERFACE ===
+class Component {
+    friend class Group;
+    friend class JournalWriter;
+protected:
+    Group* parent = nullptr;
+    std::atomic<bool> dirty{false}; // changed since the last save (delta saves)
+    bool pooled = false; // memory belongs to a NodeArena: destroy, never delete
+    std::unique_ptr<RevenueHistory> history; // opt-in, see Group::enableHistory()
+
+    // Flags this node and its ancestors. Stops at the first ancestor that is
+    // already flagged: everything above it is flagged too.
+    void markDirty();
+
+    // Adds `amount` to the history of this node and every ancestor keeping one.
+    void recordHistory(Money amount, RevenueHistory::Clock::time_point at);
+
+public:
+    virtual ~Component() = default;
+    virtual void display(TextWriter& out, int indent = 0) = 0;
+    virtual Money getRevenue() = 0;
+    virtual void save(TextWriter& out, int depth = 0) = 0;
+    virtual bool isGroup() = 0;
+
+    Group* getParent() { return parent; }
+    bool isDirty() const { return dirty.load(); }
+
+    bool hasHistory() const { return history != nullptr; }
+
+    // Revenue added during the last `window`; zero without a history.
+    Money revenueInLast(std::chrono::minutes window,
+                        RevenueHistory::Clock::time_point now = RevenueHistory::Clock::now()) const {
+        return history ? history->window(window, now) : Money();
+    }
+};
+
+// === LEAF: GAME ===
+class Game : public Component {
+    friend class RevenueBatch;
+    friend class GameRanking;
+    friend class Group;
+    friend class JournalWriter;
+private:
+    Name name;
+    std::atomic<Money::Raw> revenue;
+    Money::Raw savedRevenue; // value in the last snapshot or journal entry
+public:
+    Game(std::string_view n, Money r) : name(n), revenue(r.minorUnits()), savedRevenue(r.minorUnits()) {}
+
+    void display(TextWriter& out, int indent = 0) override {
+        out.indent(indent) << name.view() << " | Revenue: " << getRevenue() << '\n';
+    }
+
+    Money getRevenue() override { return Money::fromUnits(revenue.load(std::memory_order_relaxed)); }
+
+    void save(TextWriter& out, int depth = 0) override {
+        out.indent(depth) << "GAME " << name.view() << ' ' << getRevenue() << '\n';
+    }
+
+    bool isGroup() override { return false; }
+
+    std::string_view getName() const { return name.view(); }
+    Name getNameHandle() const { return name; }
+
+    // Safe to call from many threads at once. Structural changes (Group::add,
+    // loading, enabling the index) still need exclusive access to the tree.
+    void addRevenue(Money amount);
+
+    // Same, for revenue that came in at `at` rather than now.
+    void addRevenue(Money amount, RevenueHistory::Clock::time_point at);
+};
+
+// === NODE POOL ===
+// Deleter shared by heap-allocated and pooled nodes. Pooled nodes are only
+// destroyed; their memory goes back when the owning NodeArena is released.
+struct NodeDeleter {
+    bool pooled = false;
+
+    NodeDeleter() = default;
+    explicit NodeDeleter(bool fromPool) : pooled(fromPool) {}
+    template <class T>
+    NodeDeleter(const std::default_delete<T>&) noexcept {}
+
+    void operator()(Component* node) const {
+        if (pooled) node->~Component();
+        else delete node;
+    }
+};
+
+using NodePtr = std::unique_ptr<Component, NodeDeleter>;
+
+// Monotonic arena for one tree's nodes and child vectors. Nodes are packed
+// together in large blocks and teardown frees the blocks, not every node.
+// Not thread-safe: like every structural change it needs exclusive access.
+class NodeArena {
+private:
+    std::pmr::monotonic_buffer_resource resource{size_t(1) << 16};
+    std::vector<std::unique_ptr<NodeArena>> adopted; // merged in from other trees
+public:
+    std::pmr::memory_resource* memory() { return &resource; }
+
+    // Keeps `other` alive as long as this arena, so nodes built in it can
+    // join this tree.
+    void adopt(std::unique_ptr<NodeArena> other) { adopted.push_back(std::move(other)); }
+
+    template <class T, class... Args>
+    T* create(Args&&... args) {
+        void* p = resource.allocate(sizeof(T), alignof(T));
+        return ::new (p) T(std::forward<Args>(args)...);
+    }
+};
+
+// === NAME INDEX ===
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+// One row of an ordered listing: a node's name, its full path and the node.
+// The views point into the index and stay valid while it does. Nodes that
+// share a path are numbered 1..copies in the order they were indexed.
+template <class Node>
+struct NameEntry {
+    std::string_view name;
+    std::string_view path;
+    Node* node;
+    size_t ordinal = 1;
+    size_t copies = 1;
+};
+
+// A window of an ordered listing plus how many rows match in all.
+template <class Node>
+struct NamePage {
+    std::vector<NameEntry<Node>> rows;
+    size_t matches = 0;
+};
+
+// Hash lookup of games by full path ("Casino Games/Table Games/Blackjack")
+// and by bare name. Owned by the root group and kept current by Group::add().
+// Siblings may share a name, so a path can belong to several nodes: lookups
+// treat such a path as ambiguous, like a name shared by several games.
+//
+// listGames()/listGroups() page through the same entries in name order. The
+// sorted views are built on first use and rebuilt after the index changes,
+// so a listing costs O(log n + rows) instead of a walk over the tree; like
+// insert(), they must not race with changes to the tree's shape.
+class GameIndex {
+private:
+    std::unordered_multimap<std::string, Game*, StringHash, std::equal_to<>> byPath;
+    std::unordered_multimap<Name, Game*, NameHash> byName;
+    std::unordered_multimap<std::string, Group*, StringHash, std::equal_to<>> groupsByPath;
+    std::vector<NameEntry<Game>> gamesByName;
+    std::vector<NameEntry<Group>> groupsByName;
+    bool gamesSorted = false;
+    bool groupsSorted = false;
+
+    // A row for a node just indexed under `path` (a key in one of the maps).
+    // The name is the path's last segment, so no node has to be touched.
+    template <class Node>
+    static void addRow(std::vector<NameEntry<Node>>& rows, std::string_view path, Node* node) {
+        rows.push_back({path.substr(path.rfind('/') + 1), path, node});
+    }
+
+    // Orders every indexed node by name, then path. The sort is stable and
+    // the rows start out in indexing order, so nodes sharing a path keep
+    // their tree order and their numbers across rebuilds.
+    template <class Node>
+    static void sortByName(std::vector<NameEntry<Node>>& rows) {
+        std::stable_sort(rows.begin(), rows.end(), [](const NameEntry<Node>& a, const NameEntry<Node>& b) {
+            return a.name != b.name ? a.name < b.name : a.path < b.path;
+        });
+        for (size_t i = 0, end; i < rows.size(); i = end) {
+            for (end = i + 1; end < rows.size() && rows[end].path == rows[i].path;) ++end;
+            for (size_t j = i; j < end; ++j) {
+                rows[j].ordinal = j - i + 1;
+                rows[j].copies = end - i;
+            }
+        }
+    }
+
+    template <class Node>
+    static NamePage<Node> page(const std::vector<NameEntry<Node>>& rows, std::string_view prefix, size_t offset,
+                               size_t limit) {
+        auto first = std::lower_bound(rows.begin(), rows.end(), prefix,
+                                      [](const NameEntry<Node>& e, std::string_view p) { return e.name < p; });
+        auto last = std::partition_point(first, rows.end(), [&](const NameEntry<Node>& e) {
+            return e.name.substr(0, prefix.size()) == prefix;
+        });
+        NamePage<Node> result;
+        result.matches = size_t(last - first);
+        if (offset < result.matches) {
+            auto from = first + std::ptrdiff_t(offset);
+            result.rows.assign(from, from + std::ptrdiff_t(std::min(limit, result.matches - offset)));
+        }
+        return result;
+    }
+
+    // The only node stored under `key`; nullptr if there is none or several.
+    template <class Map>
+    static auto unique(const Map& map, std::string_view key) -> decltype(map.begin()->second) {
+        auto [first, last] = map.equal_range(key);
+        if (first == last || std::next(first) != last) return nullptr;
+        return first->second;
+    }
+
+public:
+    void insertGroup(std::string path, Group* group) {
+        auto it = groupsByPath.emplace(std::move(path), group);
+        addRow(groupsByName, it->first, group);
+        groupsSorted = false;
+    }
+
+    // nullptr if no group or more than one has this path.
+    Group* findGroup(std::string_view path) const { return unique(groupsByPath, path); }
+
+    size_t groupPathCount(std::string_view path) const { return groupsByPath.count(path); }
+
+    void insert(std::string path, Game* game) {
+        byName.emplace(game->getNameHandle(), game);
+        auto it = byPath.emplace(std::move(path), game);
+        addRow(gamesByName, it->first, game);
+        gamesSorted = false;
+    }
+
+    // nullptr if no game or more than one has this path.
+    Game* findPath(std::string_view path) const { return unique(byPath, path); }
+
+    size_t pathCount(std::string_view path) const { return byPath.count(path); }
+
+    std::vector<Game*> findName(std::string_view name) const {
+        std::vector<Game*> result;
+        Name handle;
+        if (!Name::find(name, handle)) return result;
+        auto [first, last] = byName.equal_range(handle);
+        for (auto it = first; it != last; ++it) result.push_back(it->second);
+        return result;
+    }
+
+    // A full path or a name that belongs to exactly one game.
+    Game* find(std::string_view key) const {
+        if (Game* game = findPath(key)) return game;
+        if (pathCount(key)) return nullptr; // an ambiguous path is not retried as a name
+        Name handle;
+        if (!Name::find(key, handle)) return nullptr;
+        auto [first, last] = byName.equal_range(handle);
+        if (first == last || std::next(first) != last) return nullptr;
+        return first->second;
+    }
+
+    size_t size() const { return byPath.size(); }
+
+    // Games whose name starts with `prefix` (all for ""), rows
+    // [offset, offset + limit) of them in name order.
+    NamePage<Game> listGames(std::string_view prefix, size_t offset, size_t limit) {
+        if (!gamesSorted) sortByName(gamesByName);
+        gamesSorted = true;
+        return page(gamesByName, prefix, offset, limit);
+    }
+
+    // The same for groups, the root included.
+    NamePage<Group> listGroups(std::string_view prefix, size_t offset, size_t limit) {
+        if (!groupsSorted) sortByName(groupsByName);
+        groupsSorted = true;
+        return page(groupsByName, prefix, offset, limit);
+    }
+};
+
+// === RANKING ===
+// Games ordered by revenue, kept current as revenue streams in: set up with
+// Group::enableRanking() on a root, after which addRevenue(), batches and
+// new games reposition their entries in O(log n). top(k) is then O(k).
+//
+// Games are spread over shards by address, each with its own lock and
+// order, so threads updating different games rarely wait on each other; a
+// batch takes each shard's lock once. top() merges the shards' leaders and
+// rankOf() counts across all of them.
+class GameRanking {
+private:
+    using Entry = std::pair<Money::Raw, Game*>;
+    static constexpr size_t shardCount = 16;
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::set<Entry, std::greater<>> order;
+        std::unordered_map<Game*, Money::Raw> ranked; // key each game sits under
+
+        // With `mutex` held. Revenue is read under the lock, so racing
+        // updates of one game settle on its final value.
+        void update(Game* game) {
+            Money::Raw now = game->revenue.load(std::memory_order_relaxed);
+            auto [it, inserted] = ranked.try_emplace(game, now);
+            if (!inserted) {
+                if (it->second == now) return;
+                order.erase({it->second, game});
+                it->second = now;
+            }
+            order.insert({now, game});
+        }
+    };
+
+    std::array<Shard, shardCount> shards;
+
+    static size_t shardOf(Game* game) {
+        return (reinterpret_cast<std::uintptr_t>(game) / alignof(Game)) % shardCount;
+    }
+
+public:
+    // Moves `game` to where its current revenue belongs.
+    void update(Game* game) {
+        Shard& shard = shards[shardOf(game)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.update(game);
+    }
+
+    // The same for many games, locking each shard once.
+    void update(std::span<Game* const> games) {
+        std::array<std::vector<Game*>, shardCount> byShard;
+        for (Game* game : games) byShard[shardOf(game)].push_back(game);
+        for (size_t i = 0; i < shardCount; ++i) {
+            if (byShard[i].empty()) continue;
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            for (Game* game : byShard[i]) shards[i].update(game);
+        }
+    }
+
+    std::vector<Game*> top(size_t k) const {
+        std::vector<Entry> leaders;
+        for (const Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            size_t taken = 0;
+            for (auto it = shard.order.begin(); it != shard.order.end() && taken < k; ++it, ++taken)
+                leaders.push_back(*it);
+        }
+        size_t count = std::min(k, leaders.size());
+        std::partial_sort(leaders.begin(), leaders.begin() + std::ptrdiff_t(count), leaders.end(), std::greater<>());
+        std::vector<Game*> result;
+        result.reserve(count);
+        for (size_t i = 0; i < count; ++i) result.push_back(leaders[i].second);
+        return result;
+    }
+
+    // 1 for the top game, 0 if the game is not ranked. O(rank).
+    size_t rankOf(Game* game) const {
+        Entry entry;
+        {
+            const Shard& own = shards[shardOf(game)];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            auto it = own.ranked.find(game);
+            if (it == own.ranked.end()) return 0;
+            entry = {it->second, game};
+        }
+        size_t ahead = 0;
+        for (const Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            ahead += size_t(std::distance(shard.order.begin(), shard.order.lower_bound(entry)));
+        }
+        return ahead + 1;
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.order.size();
+        }
+        return total;
+    }
+};
+
+// === COMPOSITE: GROUP ===
+class MappedFile;
+
+// Where the unparsed children of a lazily loaded group are: the bytes after
+// its own line, up to `end` or the first line indented no deeper than `depth`.
+struct LazyExtent {
+    std::shared_ptr<const MappedFile> file;
+    size_t begin = 0;
+    size_t end = 0;
+    int depth = 0;
+};
+
+class Group : public Component {
+    friend class RevenueBatch;
+    friend class JournalWriter;
+private:
+    std::unique_ptr<NodeArena> arena; // declared first so it outlives the children
+    NodeArena* pool = nullptr;        // where addGame()/addGroup() allocate
+    Name name;
+    std::pmr::vector<Component*> children; // owned, freed as NodeDeleter would
+    ShardedCounter total; // cached sum of the whole subtree
+    size_t gameCount = 0; // games anywhere below this group
+    std::unique_ptr<GameIndex> index; // only ever set on a root
+    std::unique_ptr<GameRanking> ranking; // only ever set on a root
+    size_t persistedChildren = 0; // children already in the snapshot/journal
+    std::unique_ptr<LazyExtent> lazy; // children not parsed yet
+    size_t lazyBelow = 0; // unexpanded groups in this subtree, this one included
+
+    // Unexpanded groups are indexed without their children; expanding them
+    // later adds those through link().
+    void indexSubtree(GameIndex& idx, Component* node, const std::string& prefix) {
+        if (node->isGroup()) {
+            auto* group = static_cast<Group*>(node);
+            std::string path = prefix;
+            path += group->name.view();
+            idx.insertGroup(path, group);
+            path += '/';
+            for (auto& child : group->children) indexSubtree(idx, child, path);
+        } else {
+            auto* game = static_cast<Game*>(node);
+            std::string path = prefix;
+            path += game->getName();
+            idx.insert(std::move(path), game);
+        }
+    }
+
+public:
+    explicit Group(std::string_view n, NodeArena* p = nullptr)
+        : pool(p), name(n), children(p ? p->memory() : std::pmr::get_default_resource()) {}
+
+    ~Group() override {
+        for (Component* child : children) NodeDeleter(child->pooled)(child);
+    }
+
+    // add() without expanding this group or flagging it dirty; a lazy group
+    // added here stays lazy.
+    void link(NodePtr component) {
+        component->parent = this;
+        Component* added = component.get();
+        Money delta;
+        size_t games = 1;
+        size_t lazyGroups = 0;
+        if (added->isGroup()) {
+            auto* group = static_cast<Group*>(added);
+            group->index.reset();
+            group->ranking.reset();
+            delta = group->total.load();
+            games = group->gameCount;
+            lazyGroups = group->lazyBelow;
+        } else {
+            delta = added->getRevenue();
+        }
+        children.push_back(added);
+        added->pooled = component.get_deleter().pooled;
+        component.release();
+        adjustTotal(delta);
+        for (Group* g = this; g; g = g->parent) {
+            g->gameCount += games;
+            g->lazyBelow += lazyGroups;
+        }
+        if (history) enableHistory(added);
+        if (GameRanking* r = getRanking()) rankSubtree(*r, added);
+        if (GameIndex* idx = getIndex()) indexSubtree(*idx, added, getPath() + '/');
+    }
+
+    static void rankSubtree(GameRanking& r, Component* node) {
+        if (!node->isGroup()) {
+            r.update(static_cast<Game*>(node));
+            return;
+        }
+        for (auto& child : static_cast<Group*>(node)->children) rankSubtree(r, child);
+    }
+
+    static void enableHistory(Component* node) {
+        std::vector<Component*> pending{node};
+        while (!pending.empty()) {
+            Component* c = pending.back();
+            pending.pop_back();
+            if (!c->history) c->history = std::make_unique<RevenueHistory>();
+            if (!c->isGroup()) continue;
+            for (auto& child : static_cast<Group*>(c)->children) pending.push_back(child);
+        }
+    }
+
+    Game* newGame(std::string_view n, Money revenue) {
+        return pool ? pool->create<Game>(n, revenue) : new Game(n, revenue);
+    }
+
+    Group* newGroup(std::string_view n) { return pool ? pool->create<Group>(n, pool) : new Group(n); }
+
+    NodePtr own(Component* node) const { return NodePtr(node, NodeDeleter(pool != nullptr)); }
+
+    // Takes ownership of a heap node (e.g. from std::make_unique) or of a node
+    // from this tree's pool. Pooled nodes must stay inside their own tree.
+    // False, and the node is destroyed, if its name is not storable.
+    bool add(NodePtr component) {
+        std::string_view n = component->isGroup() ? static_cast<Group*>(component.get())->getName()
+                                                  : static_cast<Game*>(component.get())->getName();
+        if (!isStorableName(n)) return false;
+        expand();
+        link(std::move(component));
+        markDirty();
+        return true;
+    }
+
+    // Gives this (root) group an arena; groups created through addGroup()
+    // below it share the same arena.
+    void enablePool() {
+        if (!pool) {
+            arena = std::make_unique<NodeArena>();
+            pool = arena.get();
+        }
+    }
+
+    // nullptr if `n` is not a storable name.
+    Game* addGame(std::string_view n, Money revenue) {
+        if (!isStorableName(n)) return nullptr;
+        Game* game = newGame(n, revenue);
+        add(own(game));
+        return game;
+    }
+
+    // `capacity` reserves room for the new group's children, see reserve().
+    Group* addGroup(std::string_view n, size_t capacity = 0) {
+        if (!isStorableName(n)) return nullptr;
+        Group* group = newGroup(n);
+        group->children.reserve(capacity);
+        add(own(group));
+        return group;
+    }
+
+    // Room for `n` more children. Worth it for big groups in a pooled tree:
+    // the arena never takes memory back, so each regrowth of the child
+    // vector leaves the old copy behind.
+    void reserve(size_t n) {
+        expand();
+        children.reserve(children.size() + n);
+    }
+
+    // Leaves this (childless) group's children in `extent` until something
+    // needs them: see expand().
+    void defer(LazyExtent extent) {
+        lazy = std::make_unique<LazyExtent>(std::move(extent));
+        for (Group* g = this; g; g = g->parent) g->lazyBelow++;
+    }
+
+    bool isExpanded() const { return !lazy; }
+
+    // Starts keeping a RevenueHistory on this group and everything below it,
+    // including nodes added or expanded later. Only revenue added from now
+    // on is bucketed; each group's buckets already hold its subtree's sums,
+    // so window queries never walk the children.
+    void enableHistory() { enableHistory(this); }
+
+    // Parses the deferred children, if any. Child groups come back deferred
+    // in turn, so this costs one scan of the group's bytes, not a full parse.
+    // Called by everything that looks at the children; not thread-safe.
+    void expand();
+
+    // Expands every deferred group in the subtree.
+    void expandAll() {
+        std::vector<Group*> pending{this};
+        while (!pending.empty()) {
+            Group* g = pending.back();
+            pending.pop_back();
+            if (!g->lazyBelow) continue;
+            g->expand();
+            for (auto& child : g->children) {
+                if (child->isGroup()) pending.push_back(static_cast<Group*>(child));
+            }
+        }
+    }
+
+    // Moves every child of `from`, whose nodes were built in `nodes`, to the
+    // end of this group; the arena is handed to this tree's pool. `from` is
+    // left without children and should only be destroyed afterwards.
+    void adopt(Group& from, std::unique_ptr<NodeArena> nodes) {
+        from.expand();
+        enablePool();
+        for (Component* child : from.children) add(NodePtr(child, NodeDeleter(child->pooled)));
+        from.children.clear();
+        pool->adopt(std::move(nodes));
+    }
+
+    // Builds the index for this (root) group; later add() calls keep it current.
+    GameIndex* enableIndex() {
+        if (!index) {
+            index = std::make_unique<GameIndex>();
+            std::string prefix(name.view());
+            index->insertGroup(prefix, this);
+            prefix += '/';
+            for (auto& child : children) indexSubtree(*index, child, prefix);
+        }
+        return index.get();
+    }
+
+    GameIndex* getIndex() {
+        Group* g = this;
+        while (g->parent) g = g->parent;
+        return g->index.get();
+    }
+
+    // Maintains a GameRanking for this (root) group from now on. Covers the
+    // games that are loaded; lazily loaded groups join as they expand.
+    GameRanking* enableRanking() {
+        if (!ranking) {
+            ranking = std::make_unique<GameRanking>();
+            rankSubtree(*ranking, this);
+        }
+        return ranking.get();
+    }
+
+    GameRanking* getRanking() {
+        Group* g = this;
+        while (g->parent) g = g->parent;
+        return g->ranking.get();
+    }
+
+    // Names from the root down, joined with '/'.
+    std::string getPath() {
+        std::vector<Group*> chain;
+        for (Group* g = this; g; g = g->parent) chain.push_back(g);
+        std::string path;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            if (!path.empty()) path += '/';
+            path += (*it)->name.view();
+        }
+        return path;
+    }
+
+    // Pushes a revenue change into this group and every ancestor: O(depth).
+    void adjustTotal(Money delta) {
+        for (Group* g = this; g; g = g->parent) {
+            g->total.add(delta);
+        }
+    }
+
+    void display(TextWriter& out, int indent = 0) override {
+        expand();
+        out.indent(indent) << "----- " << name.view() << " -----" << '\n';
+        for (auto& child : children) {
+            child->display(out, indent + 1);
+        }
+        out.indent(indent) << "Total: " << getRevenue() << '\n';
+    }
+
+    Money getRevenue() override {
+        CASINO_TIMED(GetRevenue);
+        if (lazyBelow) expandAll();
+        return total.load();
+    }
+
+    size_t getGameCount() {
+        if (lazyBelow) expandAll();
+        return gameCount;
+    }
+
+    // Declares the whole subtree saved: clears the dirty flags and records the
+    // current revenues and child counts as the persisted state.
+    void markPersisted() {
+        std::vector<Group*> pending{this};
+        while (!pending.empty()) {
+            Group* g = pending.back();
+            pending.pop_back();
+            g->dirty.store(false);
+            g->persistedChildren = g->children.size();
+            for (auto& child : g->children) {
+                if (child->isGroup()) {
+                    pending.push_back(static_cast<Group*>(child));
+                } else {
+                    auto* game = static_cast<Game*>(child);
+                    game->dirty.store(false);
+                    game->savedRevenue = game->revenue.load();
+                }
+            }
+        }
+    }
+
+    void save(TextWriter& out, int depth = 0) override {
+        expand();
+        out.indent(depth) << "GROUP " << name.view() << '\n';
+        for (auto& child : children) {
+            child->save(out, depth + 1);
+        }
+    }
+
+    bool isGroup() override { return true; }
+
+    std::string_view getName() const { return name.view(); }
+    Name getNameHandle() const { return name; }
+    // The children in place, without copying them out; the view lasts until
+    // the next change to this group's children.
+    std::span<Component* const> getChildren() {
+        expand();
+        return children;
+    }
+
+    std::vector<Game*> getAllGames() {
+        expand();
+        std::vector<Game*> games;
+        for (auto& child : children) {
+            if (child->isGroup()) {
+                auto subGames = static_cast<Group*>(child)->getAllGames();
+                games.insert(games.end(), subGames.begin(), subGames.end());
+            } else {
+                games.push_back(static_cast<Game*>(child));
+            }
+        }
+        return games;
+    }
+};
+
+inline void Component::markDirty() {
+    for (Component* c = this; c && !c->dirty.load(); c = c->parent) {
+        c->dirty.store(true);
+    }
+}
+
+inline void Component::recordHistory(Money amount, RevenueHistory::Clock::time_point at) {
+    for (Component* c = this; c; c = c->parent) {
+        if (c->history) c->history->record(amount, at);
+    }
+}
+
+inline void Game::addRevenue(Money amount, RevenueHistory::Clock::time_point at) {
+    CASINO_TIMED(AddRevenue);
+    CASINO_COUNT(RevenueEvents, 1);
+    revenue.fetch_add(amount.minorUnits(), std::memory_order_relaxed);
+    if (parent) {
+        parent->adjustTotal(amount);
+        if (GameRanking* r = parent->getRanking()) r->update(this);
+    }
+    markDirty();
+    if (history) recordHistory(amount, at);
+}
+
+inline void Game::addRevenue(Money amount) {
+    addRevenue(amount, history ? RevenueHistory::Clock::now() : RevenueHistory::Clock::time_point());
+}
+
+// === TREE BUILDER ===
+// Builds a pooled tree top-down from an importer's events, with the same
+// openGroup()/addGame()/closeGroup() calls as FlatTree. Nodes are built in
+// place in the tree's arena, and with child counts given up front every
+// child vector is allocated once, so an import allocates per arena block
+// rather than per node. Names new to the process are still interned once
+// each.
+class TreeBuilder {
+private:
+    std::unique_ptr<Group> root;
+    std::vector<Group*> open; // root first, innermost open group last
+
+public:
+    explicit TreeBuilder(std::string_view rootName, size_t expectedChildren = 0)
+        : root(std::make_unique<Group>(rootName)) {
+        root->enablePool();
+        root->reserve(expectedChildren);
+        open.reserve(16);
+        open.push_back(root.get());
+    }
+
+    Group& current() { return *open.back(); }
+
+    // Room for `n` more children in the innermost open group.
+    void reserve(size_t n) { open.back()->reserve(n); }
+
+    // nullptr, and nothing opened, if the name is not storable.
+    Group* openGroup(std::string_view name, size_t expectedChildren = 0) {
+        Group* group = open.back()->addGroup(name, expectedChildren);
+        if (group) open.push_back(group);
+        return group;
+    }
+
+    Game* addGame(std::string_view name, Money revenue) { return open.back()->addGame(name, revenue); }
+
+    // False, and nothing closed, if only the root is open.
+    bool closeGroup() {
+        if (open.size() == 1) return false;
+        open.pop_back();
+        return true;
+    }
+
+    // The tree, with any groups still open closed. The builder is spent.
+    std::unique_ptr<Group> finish() {
+        open.clear();
+        return std::move(root);
+    }
+};
+
+// === VECTOR KERNELS ===
+// Reductions over contiguous minor-unit arrays. With AVX-512 or AVX2 enabled
+// at compile time (CASINO_NATIVE_ARCH in CMake, or -march) the explicit
+// kernels are used; otherwise the scalar loops are written so the compiler
+// can vectorize them for the baseline target.
+inline Money::Raw sumUnits(const Money::Raw* values, size_t count) {
+    size_t i = 0;
+    Money::Raw total = 0;
+#if defined(__AVX512F__)
+    __m512i acc0 = _mm512_setzero_si512();
+    __m512i acc1 = _mm512_setzero_si512();
+    for (; i + 16 <= count; i += 16) {
+        acc0 = _mm512_add_epi64(acc0, _mm512_loadu_si512(values + i));
+        acc1 = _mm512_add_epi64(acc1, _mm512_loadu_si512(values + i + 8));
+    }
+    alignas(64) Money::Raw lanes[8];
+    _mm512_store_si512(lanes, _mm512_add_epi64(acc0, acc1));
+    for (Money::Raw lane : lanes) total += lane;
+#elif defined(__AVX2__)
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm256_add_epi64(acc0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)));
+        acc1 = _mm256_add_epi64(acc1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + 4)));
+    }
+    alignas(32) Money::Raw lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(acc0, acc1));
+    total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+    Money::Raw lanes[4] = {0, 0, 0, 0};
+    for (; i + 4 <= count; i += 4) {
+        lanes[0] += values[i];
+        lanes[1] += values[i + 1];
+        lanes[2] += values[i + 2];
+        lanes[3] += values[i + 3];
+    }
+    total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < count; ++i) total += values[i];
+    return total;
+}
+
+// Writes the exclusive prefix sums of `values` to `prefix` (count + 1
+// entries, prefix[0] == 0), so the sum of any range [a, b) is
+// prefix[b] - prefix[a].
+inline void prefixSumUnits(const Money::Raw* values, size_t count, Money::Raw* prefix) {
+    size_t i = 0;
+    Money::Raw running = 0;
+    prefix[0] = 0;
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i carry = zero;
+    for (; i + 4 <= count; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        // In-register inclusive scan: add the vector shifted up by one lane,
+        // then by two lanes.
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x03));
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x0F));
+        x = _mm256_add_epi64(x, carry);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(prefix + i + 1), x);
+        carry = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    if (i > 0) running = prefix[i];
+#endif
+    for (; i < count; ++i) {
+        running += values[i];
+        prefix[i + 1] = running;
+    }
+}
+
+// === FLAT STORAGE ===
+// Append-only pool of names; equal names are stored once and share an id.
+class StringPool {
+private:
+    std::deque<std::string> storage; // deque keeps the views below stable
+    std::vector<std::string_view> views;
+    std::unordered_map<std::string_view, std::uint32_t> lookup;
+public:
+    std::uint32_t intern(std::string_view s) {
+        auto it = lookup.find(s);
+        if (it != lookup.end()) return it->second;
+        std::string_view stored = storage.emplace_back(s);
+        auto id = static_cast<std::uint32_t>(views.size());
+        views.push_back(stored);
+        lookup.emplace(stored, id);
+        return id;
+    }
+
+    std::string_view get(std::uint32_t id) const { return views[id]; }
+    size_t size() const { return views.size(); }
+};
+
+// Keeps the k best (revenue, item) pairs seen so far in a min-heap, so
+// selecting from n candidates is O(n log k) and never sorts all of them.
+// Equal revenues keep the order they were offered in.
+template <class Item>
+class TopK {
+private:
+    struct Entry {
+        Money::Raw revenue;
+        size_t order;
+        Item item;
+    };
+    static bool better(const Entry& a, const Entry& b) {
+        return a.revenue != b.revenue ? a.revenue > b.revenue : a.order < b.order;
+    }
+
+    size_t k;
+    size_t offered = 0;
+    std::vector<Entry> heap; // heap.front() is the worst entry kept
+
+public:
+    explicit TopK(size_t count) : k(count) { heap.reserve(count); }
+
+    void offer(Money::Raw revenue, Item item) {
+        Entry e{revenue, offered++, item};
+        if (heap.size() < k) {
+            heap.push_back(e);
+            std::push_heap(heap.begin(), heap.end(), better);
+        } else if (k > 0 && better(e, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), better);
+            heap.back() = e;
+            std::push_heap(heap.begin(), heap.end(), better);
+        }
+    }
+
+    // Best first.
+    std::vector<Item> take() {
+        std::sort_heap(heap.begin(), heap.end(), better);
+        std::vector<Item> items;
+        items.reserve(heap.size());
+        for (const Entry& e : heap) items.push_back(e.item);
+        heap.clear();
+        return items;
+    }
+};
+
+// Structure-of-arrays tree. Nodes are stored in preorder, so every group's
+// subtree is the contiguous index range (i, end[i]) and a total is a linear
+// scan over `revenue`. Build it with openGroup()/addGame()/closeGroup() or
+// fromComponent(); the shape is fixed afterwards, revenues stay mutable.
+class FlatTree {
+public:
+    using Index = std::uint32_t;
+    static constexpr Index none = static_cast<Index>(-1);
+
+    class Node;
+
+private:
+    std::vector<Money::Raw> revenue;  // minor units, 0 for groups
+    std::vector<Index> parent;
+    std::vector<Index> firstChild;
+    std::vector<Index> nextSibling;
+    std::vector<Index> end;           // one past the last node of the subtree
+    std::vector<Name> name;
+    std::vector<std::uint8_t> group;  // 1 for groups, 0 for games
+
+    std::vector<Index> open;          // groups still being built
+    std::vector<Index> lastChild;     // parallel to `open`
+
+    Index append(std::string_view n, Money r, bool isGroup) {
+        auto i = static_cast<Index>(revenue.size());
+        Index p = open.empty() ? none : open.back();
+        revenue.push_back(r.minorUnits());
+        parent.push_back(p);
+        firstChild.push_back(none);
+        nextSibling.push_back(none);
+        end.push_back(i + 1);
+        name.push_back(Name(n));
+        group.push_back(isGroup ? 1 : 0);
+        if (p != none) {
+            if (lastChild.back() == none) firstChild[p] = i;
+            else nextSibling[lastChild.back()] = i;
+            lastChild.back() = i;
+        }
+        return i;
+    }
+
+    void copyFrom(Component* c) {
+        if (c->isGroup()) {
+            auto* g = static_cast<Group*>(c);
+            openGroup(g->getName());
+            for (Component* child : g->getChildren()) copyFrom(child);
+            closeGroup();
+        } else {
+            auto* game = static_cast<Game*>(c);
+            addGame(game->getName(), game->getRevenue());
+        }
+    }
+
+public:
+    Index openGroup(std::string_view n) {
+        Index i = append(n, Money(), true);
+        open.push_back(i);
+        lastChild.push_back(none);
+        return i;
+    }
+
+    Index addGame(std::string_view n, Money r) { return append(n, r, false); }
+
+    void closeGroup() {
+        end[open.back()] = static_cast<Index>(revenue.size());
+        open.pop_back();
+        lastChild.pop_back();
+    }
+
+    static FlatTree fromComponent(Component* root) {
+        FlatTree tree;
+        if (root) tree.copyFrom(root);
+        return tree;
+    }
+
+    size_t size() const { return revenue.size(); }
+    bool empty() const { return revenue.empty(); }
+    Node root();
+    Node node(Index i);
+
+    Money sum(Index first, Index last) const {
+        if (last <= first) return Money();
+        return Money::fromUnits(sumUnits(revenue.data() + first, last - first));
+    }
+
+    // Total of every node at once (a game's own revenue, a group's whole
+    // subtree) from a single prefix-sum pass over the revenue array.
+    std::vector<Money> subtreeTotals() const {
+        std::vector<Money::Raw> prefix(revenue.size() + 1);
+        prefixSumUnits(revenue.data(), revenue.size(), prefix.data());
+        std::vector<Money> totals(revenue.size());
+        for (Index i = 0; i < revenue.size(); ++i) {
+            Index from = group[i] ? i + 1 : i;
+            totals[i] = Money::fromUnits(prefix[end[i]] - prefix[from]);
+        }
+        return totals;
+    }
+
+    // The k highest-revenue games in the subtree of `node`, best first: one
+    // pass over the contiguous range of its subtree.
+    std::vector<Index> topK(Index node, size_t k) const {
+        TopK<Index> best(k);
+        for (Index i = node + 1; i < end[node]; ++i) {
+            if (!group[i]) best.offer(revenue[i], i);
+        }
+        if (!group[node]) best.offer(revenue[node], node);
+        return best.take();
+    }
+
+    // sum() split into one contiguous slice per thread.
+    Money parallelSum(Index first, Index last, unsigned threads = std::thread::hardware_concurrency()) const {
+        constexpr Index minSlice = 1 << 16;
+        Index count = last > first ? last - first : 0;
+        if (threads == 0) threads = 1;
+        threads = std::min<unsigned>(threads, std::max<Index>(1, count / minSlice));
+        if (threads <= 1) return sum(first, last);
+
+        std::vector<Money> partial(threads);
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; ++t) {
+            Index from = first + static_cast<Index>(std::uint64_t(count) * t / threads);
+            Index to = first + static_cast<Index>(std::uint64_t(count) * (t + 1) / threads);
+            pool.emplace_back([this, &partial, t, from, to] { partial[t] = sum(from, to); });
+        }
+        for (auto& th : pool) th.join();
+
+        Money total;
+        for (Money p : partial) total += p;
+        return total;
+    }
+
+    friend class Node;
+};
+
+// Lightweight handle that mirrors the Component/Group/Game interface.
+class FlatTree::Node {
+private:
+    FlatTree* tree;
+    Index i;
+public:
+    Node(FlatTree* t, Index index) : tree(t), i(index) {}
+
+    Index index() const { return i; }
+    bool isGroup() const { return tree->group[i] != 0; }
+    std::string_view getName() const { return tree->name[i].view(); }
+
+    // Like Component::getParent(); the root has none, check hasParent() first.
+    bool hasParent() const { return tree->parent[i] != none; }
+    Node getParent() const { return Node(tree, tree->parent[i]); }
+
+    Money getRevenue() const {
+        return isGroup() ? tree->sum(i + 1, tree->end[i]) : Money::fromUnits(tree->revenue[i]);
+    }
+
+    void addRevenue(Money amount) { tree->revenue[i] += amount.minorUnits(); }
+
+    void display(TextWriter& out, int indent = 0) const {
+        out.indent(indent);
+        if (!isGroup()) {
+            out << getName() << " | Revenue: " << getRevenue() << '\n';
+            return;
+        }
+        out << "----- " << getName() << " -----" << '\n';
+        for (Index c = tree->firstChild[i]; c != none; c = tree->nextSibling[c]) {
+            Node(tree, c).display(out, indent + 1);
+        }
+        out.indent(indent) << "Total: " << getRevenue() << '\n';
+    }
+
+    void save(TextWriter& out, int depth = 0) const {
+        out.indent(depth);
+        if (!isGroup()) {
+            out << "GAME " << getName() << ' ' << getRevenue() << '\n';
+            return;
+        }
+        out << "GROUP " << getName() << '\n';
+        for (Index c = tree->firstChild[i]; c != none; c = tree->nextSibling[c]) {
+            Node(tree, c).save(out, depth + 1);
+        }
+    }
+
+    std::vector<Node> getChildren() const {
+        std::vector<Node> result;
+        for (Index c = tree->firstChild[i]; c != none; c = tree->nextSibling[c]) {
+            result.emplace_back(tree, c);
+        }
+        return result;
+    }
+
+    std::vector<Node> topK(size_t k) const {
+        std::vector<Node> result;
+        for (Index game : tree->topK(i, k)) result.emplace_back(tree, game);
+        return result;
+    }
+
+    // Preorder layout: the games of a subtree are simply its non-group slots.
+    std::vector<Node> getAllGames() const {
+        std::vector<Node> games;
+        for (Index k = i + 1; k < tree->end[i]; ++k) {
+            if (!tree->group[k]) games.emplace_back(tree, k);
+        }
+        return games;
+    }
+};
+
+inline FlatTree::Node FlatTree::root() { return Node(this, 0); }
+inline FlatTree::Node FlatTree::node(Index i) { return Node(this, i); }
+
+// === PARALLEL AGGREGATION ===
+// Sums the games under `node` directly, without trusting cached totals.
+inline Money sumGames(Component* node) {
+    if (!node->isGroup()) return node->getRevenue();
+    Money total;
+    for (Component* child : static_cast<Group*>(node)->getChildren()) {
+        total += sumGames(child);
+    }
+    return total;
+}
+
+// Parallel recount of a subtree from its leaves, for reports that must not
+// rely on the incrementally maintained totals. Groups holding more than
+// `grain` games are split into their children; the resulting work items are
+// handed out dynamically to the worker threads, so uneven subtrees still
+// balance. Small trees never start a thread.
+inline Money aggregateRevenue(Group& root, unsigned threads = std::thread::hardware_concurrency(),
+                        size_t grain = 0) {
+    if (threads == 0) threads = 1;
+    if (grain == 0) grain = std::max<size_t>(4096, root.getGameCount() / (size_t(threads) * 8));
+    if (threads == 1 || root.getGameCount() <= grain) return sumGames(&root);
+
+    // A work item is either a whole subtree or the direct games of a group
+    // that was split.
+    struct Work {
+        Component* node;
+        bool directGamesOnly;
+    };
+    std::vector<Work> work;
+    std::vector<Group*> pending{&root};
+    while (!pending.empty()) {
+        Group* group = pending.back();
+        pending.pop_back();
+        bool hasGames = false;
+        for (Component* child : group->getChildren()) {
+            if (!child->isGroup()) hasGames = true;
+            else if (static_cast<Group*>(child)->getGameCount() > grain) pending.push_back(static_cast<Group*>(child));
+            else work.push_back({child, false});
+        }
+        if (hasGames) work.push_back({group, true});
+    }
+
+    std::vector<Money> partial(work.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < work.size();) {
+            if (!work[i].directGamesOnly) {
+                partial[i] = sumGames(work[i].node);
+                continue;
+            }
+            Money sum;
+            for (Component* child : static_cast<Group*>(work[i].node)->getChildren()) {
+                if (!child->isGroup()) sum += child->getRevenue();
+            }
+            partial[i] = sum;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    unsigned helpers = static_cast<unsigned>(std::min<size_t>(threads, work.size())) - 1;
+    for (unsigned t = 0; t < helpers; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    Money total;
+    for (Money p : partial) total += p;
+    return total;
+}
+
+// === TOP-K QUERIES ===
+inline void offerGames(TopK<Game*>& best, Component* node) {
+    if (!node->isGroup()) {
+        best.offer(node->getRevenue().minorUnits(), static_cast<Game*>(node));
+        return;
+    }
+    for (Component* child : static_cast<Group*>(node)->getChildren()) offerGames(best, child);
+}
+
+// The k highest-revenue games under `group`, best first, ties in tree order.
+// One walk with a k-sized heap instead of copying and sorting getAllGames();
+// for repeated queries on a whole tree see Group::enableRanking().
+inline std::vector<Game*> topK(Group& group, size_t k) {
+    TopK<Game*> best(k);
+    offerGames(best, &group);
+    return best.take();
+}
+
+// === VARIANT NODES ===
+// Alternative representation with a closed set of node kinds: a node is a
+// std::variant of a game or a group, stored by value inside its parent's
+// vector. There is no vtable and no isGroup()/static_cast pair, so the
+// visitors below can be inlined into the traversals.
+struct VariantNode;
+
+struct VariantGame {
+    Name name;
+    Money revenue;
+};
+
+struct VariantGroup {
+    Name name;
+    std::vector<VariantNode> children;
+};
+
+struct VariantNode {
+    std::variant<VariantGame, VariantGroup> value;
+
+    bool isGroup() const { return std::holds_alternative<VariantGroup>(value); }
+};
+
+inline Money variantRevenue(const VariantNode& node) {
+    return std::visit([](const auto& n) -> Money {
+        if constexpr (std::is_same_v<std::decay_t<decltype(n)>, VariantGame>) {
+            return n.revenue;
+        } else {
+            Money total;
+            for (const auto& child : n.children) total += variantRevenue(child);
+            return total;
+        }
+    }, node.value);
+}
+
+inline void variantSave(const VariantNode& node, TextWriter& out, int depth = 0) {
+    std::visit([&](const auto& n) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(n)>, VariantGame>) {
+            out.indent(depth) << "GAME " << n.name.view() << ' ' << n.revenue << '\n';
+        } else {
+            out.indent(depth) << "GROUP " << n.name.view() << '\n';
+            for (const auto& child : n.children) variantSave(child, out, depth + 1);
+        }
+    }, node.value);
+}
+
+inline void variantDisplay(const VariantNode& node, TextWriter& out, int indent = 0) {
+    std::visit([&](const auto& n) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(n)>, VariantGame>) {
+            out.indent(indent) << n.name.view() << " | Revenue: " << n.revenue << '\n';
+        } else {
+            out.indent(indent) << "----- " << n.name.view() << " -----" << '\n';
+            for (const auto& child : n.children) variantDisplay(child, out, indent + 1);
+            out.indent(indent) << "Total: " << variantRevenue(node) << '\n';
+        }
+    }, node.value);
+}
+
+inline VariantNode toVariant(Component* node) {
+    if (!node->isGroup()) {
+        auto* game = static_cast<Game*>(node);
+        return {VariantGame{game->getNameHandle(), game->getRevenue()}};
+    }
+    auto* group = static_cast<Group*>(node);
+    VariantGroup copy{group->getNameHandle(), {}};
+    auto children = group->getChildren();
+    copy.children.reserve(children.size());
+    for (Component* child : children) copy.children.push_back(toVariant(child));
+    return {std::move(copy)};
+}
+
+// === FILE OPERATIONS ===
+inline int getDepth(std::string_view line) {
+    int depth = 0;
+    for (size_t i = 0; i + 1 < line.size() && line[i] == ' ' && line[i + 1] == ' '; i += 2) {
+        depth++;
+    }
+    return depth;
+}
+
+inline std::string_view stripIndent(std::string_view line) {
+    size_t pos = 0;
+    while (pos + 1 < line.size() && line[pos] == ' ' && line[pos + 1] == ' ') {
+        pos += 2;
+    }
+    return line.substr(pos);
+}
+
+// Returns the line starting at `pos` without its "\n" or "\r\n" and moves
+// `pos` to the start of the next one.
+inline std::string_view nextLine(std::string_view text, size_t& pos) {
+    size_t nl = text.find('\n', pos);
+    size_t stop = nl == std::string_view::npos ? text.size() : nl;
+    std::string_view line = text.substr(pos, stop - pos);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    pos = nl == std::string_view::npos ? text.size() : nl + 1;
+    return line;
+}
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// Splits "GAME" arguments the same way the istringstream tokenizer did: the
+// last word is the revenue, the words before it joined by single spaces are
+// the name. Only names with irregular spacing need a fresh string.
+inline bool parseGameArgs(std::string_view args, std::string& name, Money& revenue) {
+    while (!args.empty() && isBlank(args.back())) args.remove_suffix(1);
+    size_t split = args.size();
+    while (split > 0 && !isBlank(args[split - 1])) split--;
+    std::string_view value = args.substr(split);
+    std::string_view words = args.substr(0, split);
+    while (!words.empty() && isBlank(words.front())) words.remove_prefix(1);
+    while (!words.empty() && isBlank(words.back())) words.remove_suffix(1);
+    if (words.empty() || value.empty()) return false;
+
+    if (!Money::parse(value, revenue)) return false;
+
+    bool regular = true;
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (isBlank(words[i]) && (words[i] != ' ' || isBlank(words[i + 1]))) {
+            regular = false;
+            break;
+        }
+    }
+    if (regular) {
+        name.assign(words);
+        return true;
+    }
+    name.clear();
+    for (size_t i = 0; i < words.size();) {
+        if (isBlank(words[i])) {
+            while (isBlank(words[i])) i++;
+            name += ' ';
+        } else {
+            name += words[i++];
+        }
+    }
+    return true;
+}
+
+// Incremental parser for the indented text format. Input can arrive in
+// chunks of any size; complete lines are parsed as soon as they are seen and
+// attached to the tree through an explicit stack of open groups, so neither
+// deep nesting nor long runs of blank lines touch the call stack.
+//
+// The first non-blank line is the root. A group owns the following lines
+// that are indented deeper than itself; only lines exactly one level deeper
+// become children, anything deeper that no child group claims is skipped.
+// The root ends at the first later line indented no deeper than it.
+class StreamParser {
+private:
+    struct Frame {
+        Group* group;
+        int depth;
+    };
+
+    std::unique_ptr<Component> root;
+    std::vector<Frame> open;
+    std::string partial; // unterminated tail of the last chunk
+    std::string trailer; // first line after the root, if any
+    bool finished = false;
+
+    // Scratch for the current line, reused so names don't allocate per line.
+    enum class Kind { Group, Game, Other };
+    std::string_view groupName;
+    std::string gameName;
+    Money revenue;
+
+    Kind classify(std::string_view trimmed) {
+        if (trimmed.substr(0, 6) == "GROUP ") {
+            groupName = trimmed.substr(6);
+            return Kind::Group;
+        }
+        if (trimmed.substr(0, 5) == "GAME " && parseGameArgs(trimmed.substr(5), gameName, revenue)) {
+            return Kind::Game;
+        }
+        return Kind::Other;
+    }
+
+    void lineWithEnding(std::string_view text) {
+        if (!text.empty() && text.back() == '\r') text.remove_suffix(1);
+        line(text);
+    }
+
+public:
+    StreamParser() = default;
+
+    // Parses lines as if `into` were an already open group at `depth`: used
+    // to parse a slice of a file that starts right below the root.
+    StreamParser(Group& into, int depth) { open.push_back({&into, depth}); }
+
+    // Consumes one line (without its newline). Returns false when the line
+    // does not belong to the root; it and everything after it are ignored.
+    bool line(std::string_view text) {
+        if (finished) return false;
+        if (text.empty()) return true;
+
+        int depth = getDepth(text);
+        if (!root && open.empty()) {
+            Kind kind = classify(stripIndent(text));
+            if (kind == Kind::Group) {
+                auto group = std::make_unique<Group>(groupName);
+                CASINO_COUNT(NodesParsed, 1);
+                group->enablePool();
+                open.push_back({group.get(), depth});
+                root = std::move(group);
+            } else {
+                if (kind == Kind::Game) {
+                    root = std::make_unique<Game>(gameName, revenue);
+                    CASINO_COUNT(NodesParsed, 1);
+                }
+                finished = true;
+            }
+            return true;
+        }
+
+        while (!open.empty() && open.back().depth >= depth) open.pop_back();
+        if (open.empty()) {
+            trailer.assign(text);
+            finished = true;
+            return false;
+        }
+        if (depth != open.back().depth + 1) return true;
+
+        switch (classify(stripIndent(text))) {
+            case Kind::Group:
+                open.push_back({open.back().group->addGroup(groupName), depth});
+                CASINO_COUNT(NodesParsed, 1);
+                break;
+            case Kind::Game:
+                open.back().group->addGame(gameName, revenue);
+                CASINO_COUNT(NodesParsed, 1);
+                break;
+            case Kind::Other:
+                break;
+        }
+        return true;
+    }
+
+    // Consumes a chunk of raw text; a trailing partial line is kept until the
+    // next chunk or finish().
+    void feed(std::string_view chunk) {
+        while (!chunk.empty() && !finished) {
+            size_t nl = chunk.find('\n');
+            if (nl == std::string_view::npos) {
+                partial.append(chunk);
+                return;
+            }
+            if (partial.empty()) {
+                lineWithEnding(chunk.substr(0, nl));
+            } else {
+                partial.append(chunk.substr(0, nl));
+                lineWithEnding(partial);
+                partial.clear();
+            }
+            chunk.remove_prefix(nl + 1);
+        }
+    }
+
+    bool done() const { return finished; }
+
+    // The line that ended the root. Older readers ignore it, which is what
+    // lets journaled snapshots carry their "#JOURNAL" marker there.
+    const std::string& trailingLine() const { return trailer; }
+
+    std::unique_ptr<Component> finish() {
+        if (!partial.empty()) {
+            lineWithEnding(partial);
+            partial.clear();
+        }
+        finished = true;
+        open.clear();
+        return std::move(root);
+    }
+};
+
+// Parses the component starting at lines[index]; on return index points at
+// the first line that does not belong to it.
+inline std::unique_ptr<Component> parse(const std::vector<std::string>& lines, size_t& index) {
+    CASINO_TIMED(Parse);
+    StreamParser parser;
+    while (index < lines.size() && parser.line(lines[index])) {
+        index++;
+        if (parser.done()) break;
+    }
+    return parser.finish();
+}
+
+inline std::unique_ptr<Component> parseStream(std::istream& in) {
+    CASINO_TIMED(Parse);
+    StreamParser parser;
+    std::vector<char> buffer(1 << 16);
+    while (!parser.done() && in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        parser.feed(std::string_view(buffer.data(), static_cast<size_t>(in.gcount())));
+    }
+    return parser.finish();
+}
+
+inline std::unique_ptr<Component> loadFromFile(const std::string& filename) {
+    CASINO_TIMED(Load);
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) return nullptr;
+    return parseStream(in);
+}
+
+// === MEMORY-MAPPED LOADING ===
+// Read-only view of a whole file. Falls back to an empty view on failure.
+class MappedFile {
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) return;
+        opened = true;
+        length = static_cast<size_t>(size.QuadPart);
+        if (length == 0) return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) != 0) return;
+        opened = true;
+        length = static_cast<size_t>(st.st_size);
+        if (length == 0) return;
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) return;
+        madvise(p, length, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(p);
+#endif
+        if (!data) opened = false;
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap(const_cast<char*>(data), length);
+        if (fd >= 0) ::close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return opened; }
+    std::string_view view() const { return data ? std::string_view(data, length) : std::string_view(); }
+};
+
+inline std::unique_ptr<Component> loadFromFileMapped(const std::string& filename) {
+    CASINO_TIMED(Load);
+    MappedFile file(filename);
+    if (!file.isOpen()) return nullptr;
+
+    StreamParser parser;
+    parser.feed(file.view());
+    return parser.finish();
+}
+
+// === PARALLEL LOADING ===
+// Parses `text` like StreamParser, but splits the body of a root group into
+// one slice per thread. A slice may only start at a line indented at most
+// one level below the root: whatever the lines before it were, only the root
+// is still open there, so each slice can be parsed on its own into a holder
+// group and arena of its own and the results appended to the root in order.
+// Slices after the one that ends the root are dropped. `trailer` receives
+// the line that ended the root, as StreamParser::trailingLine() would.
+inline std::unique_ptr<Component> parseParallel(std::string_view text,
+                                                unsigned threads = std::thread::hardware_concurrency(),
+                                                std::string* trailer = nullptr) {
+    CASINO_TIMED(Parse);
+    size_t pos = 0;
+    std::string_view rootLine;
+    while (pos < text.size() && rootLine.empty()) rootLine = nextLine(text, pos);
+    constexpr size_t minSlice = size_t(1) << 20;
+    size_t slices = std::min<size_t>(std::max(threads, 1u), (text.size() - pos) / minSlice + 1);
+    if (slices < 2 || stripIndent(rootLine).substr(0, 6) != "GROUP ") {
+        StreamParser parser;
+        parser.feed(text);
+        auto root = parser.finish();
+        if (trailer) *trailer = parser.trailingLine();
+        return root;
+    }
+
+    int depth = getDepth(rootLine);
+    auto root = std::make_unique<Group>(stripIndent(rootLine).substr(6));
+    root->enablePool();
+
+    std::string_view body = text.substr(pos);
+    std::vector<size_t> cuts{pos};
+    for (size_t k = 1; k < slices; ++k) {
+        size_t at = pos + k * body.size() / slices;
+        if (at <= cuts.back()) continue;
+        if (text[at - 1] != '\n') {
+            size_t nl = text.find('\n', at);
+            at = nl == std::string_view::npos ? text.size() : nl + 1;
+        }
+        while (at < text.size()) {
+            size_t start = at;
+            std::string_view line = nextLine(text, at);
+            if (!line.empty() && getDepth(line) <= depth + 1) {
+                at = start;
+                break;
+            }
+        }
+        if (at >= text.size()) break;
+        if (at > cuts.back()) cuts.push_back(at);
+    }
+    cuts.push_back(text.size());
+
+    struct Slice {
+        std::unique_ptr<NodeArena> arena; // declared first: outlives holder
+        std::unique_ptr<Group> holder;
+        std::string trailer;
+    };
+    std::vector<Slice> parts(cuts.size() - 1);
+    auto parseSlice = [&](size_t i) {
+        Slice& part = parts[i];
+        part.arena = std::make_unique<NodeArena>();
+        part.holder = std::make_unique<Group>("", part.arena.get());
+        StreamParser parser(*part.holder, depth);
+        parser.feed(text.substr(cuts[i], cuts[i + 1] - cuts[i]));
+        parser.finish();
+        part.trailer = parser.trailingLine();
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < parts.size(); ++i) workers.emplace_back(parseSlice, i);
+    parseSlice(0);
+    for (auto& worker : workers) worker.join();
+
+    for (auto& part : parts) {
+        root->adopt(*part.holder, std::move(part.arena));
+        if (!part.trailer.empty()) {
+            if (trailer) *trailer = part.trailer;
+            break;
+        }
+    }
+    return root;
+}
+
+inline std::unique_ptr<Component> loadFromFileParallel(const std::string& filename,
+                                                       unsigned threads = std::thread::hardware_concurrency()) {
+    CASINO_TIMED(Load);
+    MappedFile file(filename);
+    if (!file.isOpen()) return nullptr;
+    return parseParallel(file.view(), threads);
+}
+
+// === LAZY LOADING ===
+inline void Group::expand() {
+    if (!lazy) return;
+    std::unique_ptr<LazyExtent> extent = std::move(lazy);
+    for (Group* g = this; g; g = g->parent) g->lazyBelow--;
+
+    // Same rules as StreamParser, one level at a time: lines exactly one
+    // level deeper are children, deeper ones belong to the child group
+    // above them (or are skipped), and a shallower line ends this group.
+    std::string_view text = extent->file->view().substr(0, extent->end);
+    int childDepth = extent->depth + 1;
+    Group* open = nullptr; // last child group, its extent still growing
+    std::string gameName;
+    Money revenue;
+    for (size_t pos = extent->begin; pos < text.size();) {
+        size_t start = pos;
+        std::string_view line = nextLine(text, pos);
+        if (line.empty()) continue;
+        int depth = getDepth(line);
+        if (depth > childDepth) continue;
+        if (open) {
+            open->lazy->end = start;
+            open = nullptr;
+        }
+        if (depth < childDepth) break;
+
+        std::string_view trimmed = stripIndent(line);
+        if (trimmed.substr(0, 6) == "GROUP ") {
+            Group* child = newGroup(trimmed.substr(6));
+            child->lazy = std::make_unique<LazyExtent>(LazyExtent{extent->file, pos, text.size(), childDepth});
+            child->lazyBelow = 1;
+            link(own(child));
+            open = child;
+        } else if (trimmed.substr(0, 5) == "GAME " && parseGameArgs(trimmed.substr(5), gameName, revenue)) {
+            link(own(newGame(gameName, revenue)));
+        }
+    }
+    persistedChildren = children.size();
+    CASINO_COUNT(NodesParsed, children.size());
+}
+
+// Maps the file and parses nothing but the root line; every group is parsed
+// when first expanded, one level at a time. The tree keeps the mapping alive
+// until its last deferred group is expanded, so the file must not change in
+// place until then; every saver below expands the tree first and replaces
+// files by rename.
+//
+// The program's own load paths stay eager: the server expands everything
+// before its workers start (expanding is not thread-safe), and the menu and
+// batch mode report totals and list games, which parse the whole file
+// anyway. This is for tools that read one part of a large file.
+inline std::unique_ptr<Component> loadFromFileLazy(const std::string& filename) {
+    CASINO_TIMED(Load);
+    auto file = std::make_shared<const MappedFile>(filename);
+    if (!file->isOpen()) return nullptr;
+
+    std::string_view text = file->view();
+    size_t pos = 0;
+    std::string_view rootLine;
+    while (pos < text.size() && rootLine.empty()) rootLine = nextLine(text, pos);
+    if (stripIndent(rootLine).substr(0, 6) != "GROUP ") {
+        StreamParser parser;
+        parser.feed(text);
+        return parser.finish();
+    }
+
+    auto root = std::make_unique<Group>(stripIndent(rootLine).substr(6));
+    root->enablePool();
+    root->defer(LazyExtent{file, pos, text.size(), getDepth(rootLine)});
+    return root;
+}
+
+// Parses everything the tree containing `node` still defers. Savers call
+// this first: the file being replaced may be the one those groups read from.
+inline void expandBeforeSave(Component* node) {
+    Component* top = node;
+    while (top->getParent()) top = top->getParent();
+    if (top->isGroup()) static_cast<Group*>(top)->expandAll();
+}
+
+// Flushes a written file, or on POSIX a directory, to stable storage.
+inline bool syncToDisk(const std::string& path, bool directory = false) {
+#ifdef _WIN32
+    if (directory) return true; // directories cannot be opened for flushing
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    bool ok = FlushFileBuffers(h) != 0;
+    CloseHandle(h);
+    return ok;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | (directory ? O_DIRECTORY : 0));
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// Writes `filename` as a whole: `write(std::ostream&)` fills a temporary
+// file next to it, which is synced to disk and only then renamed over the
+// old one. A crash or power loss leaves the old contents or the new ones,
+// never an empty or partial file. If `write` returns false or anything
+// fails, the old file is left as it was.
+template <class Write>
+bool replaceFile(const std::string& filename, Write&& write) {
+    std::string tmp = filename + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out || !write(static_cast<std::ostream&>(out))) return false;
+        out.flush();
+        if (!out) return false;
+    }
+    std::error_code ec;
+    if (!syncToDisk(tmp)) {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    std::filesystem::rename(tmp, filename, ec);
+    if (ec) return false;
+    // Makes the rename itself durable; the data is safe either way.
+    std::filesystem::path dir = std::filesystem::path(filename).parent_path();
+    syncToDisk(dir.empty() ? "." : dir.string(), true);
+    return true;
+}
+
+inline bool saveToFile(Component* root, const std::string& filename) {
+    CASINO_TIMED(Save);
+    expandBeforeSave(root);
+    bool saved = replaceFile(filename, [&](std::ostream& out) {
+        TextWriter writer(out);
+        root->save(writer, 0);
+        writer.flush();
+        return bool(out);
+    });
+    if (saved) std::cout << "Saved to: " << filename << std::endl;
+    return saved;
+}
+
+// === INCREMENTAL SAVES ===
+// A text snapshot plus an append-only journal of what changed since. The
+// snapshot ends with a "#JOURNAL <token>" line after the root and the
+// journal starts with "SNAPSHOT <token>"; a journal whose token does not
+// match is stale and ignored. Records are tab separated:
+//   GROUP <parent position>\t<name>
+//   GAME <parent position>\t<name>\t<revenue>
+//   REV <game position>\t<delta>
+// A position is the child indices from the root down, joined with '/' ("0/3"
+// is the root's first child's fourth child; "" is the root). Names are not
+// unique among siblings, so paths of names could not tell such nodes apart.
+// Structural changes only ever append children, so positions never shift
+// and "new since the last save" is every child past
+// Group::persistedChildren.
+class JournalWriter {
+private:
+    TextWriter& out;
+
+    static std::string childPosition(const std::string& parent, size_t index) {
+        std::string position = parent;
+        if (!position.empty()) position += '/';
+        position += std::to_string(index);
+        return position;
+    }
+
+    void writeNew(Component* node, const std::string& parentPosition, size_t index) {
+        if (!node->isGroup()) {
+            auto* game = static_cast<Game*>(node);
+            out << "GAME " << parentPosition << '\t' << game->name.view() << '\t' << game->getRevenue() << '\n';
+            return;
+        }
+        auto* group = static_cast<Group*>(node);
+        group->expand();
+        out << "GROUP " << parentPosition << '\t' << group->name.view() << '\n';
+        std::string position = childPosition(parentPosition, index);
+        for (size_t i = 0; i < group->children.size(); ++i) writeNew(group->children[i], position, i);
+    }
+
+public:
+    explicit JournalWriter(TextWriter& w) : out(w) {}
+
+    // Writes the changes below a dirty `group`, found at `position`, and
+    // clears the flags it passes.
+    void writeChanges(Group* group, const std::string& position) {
+        group->dirty.store(false);
+        for (size_t i = 0; i < group->persistedChildren; ++i) {
+            Component* child = group->children[i];
+            if (!child->dirty.exchange(false)) continue;
+            if (child->isGroup()) {
+                writeChanges(static_cast<Group*>(child), childPosition(position, i));
+                continue;
+            }
+            auto* game = static_cast<Game*>(child);
+            Money::Raw now = game->revenue.load();
+            if (now == game->savedRevenue) continue;
+            out << "REV " << childPosition(position, i) << '\t' << Money::fromUnits(now - game->savedRevenue) << '\n';
+            game->savedRevenue = now;
+        }
+        for (size_t i = group->persistedChildren; i < group->children.size(); ++i) {
+            Component* child = group->children[i];
+            writeNew(child, position, i);
+            child->dirty.store(false);
+            if (child->isGroup()) {
+                static_cast<Group*>(child)->markPersisted();
+            } else {
+                auto* game = static_cast<Game*>(child);
+                game->savedRevenue = game->revenue.load();
+            }
+        }
+        group->persistedChildren = group->children.size();
+    }
+};
+
+// The node at a journal position below `root`, or nullptr.
+inline Component* nodeAtPosition(Group& root, std::string_view position) {
+    Component* node = &root;
+    while (!position.empty()) {
+        if (!node->isGroup()) return nullptr;
+        size_t slash = position.find('/');
+        std::string_view step = position.substr(0, slash);
+        size_t index = 0;
+        auto [ptr, ec] = std::from_chars(step.data(), step.data() + step.size(), index);
+        if (step.empty() || ec != std::errc() || ptr != step.data() + step.size()) return nullptr;
+        auto children = static_cast<Group*>(node)->getChildren();
+        if (index >= children.size()) return nullptr;
+        node = children[index];
+        position.remove_prefix(slash == std::string_view::npos ? position.size() : slash + 1);
+    }
+    return node;
+}
+
+// Applies journal records to a tree loaded from the matching snapshot.
+// Returns false on the first record that cannot be applied.
+inline bool replayJournal(Group& root, std::string_view records) {
+    while (!records.empty()) {
+        size_t nl = records.find('\n');
+        std::string_view line = records.substr(0, nl);
+        records.remove_prefix(nl == std::string_view::npos ? records.size() : nl + 1);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty()) continue;
+
+        size_t space = line.find(' ');
+        if (space == std::string_view::npos) return false;
+        std::string_view kind = line.substr(0, space);
+        std::string_view args = line.substr(space + 1);
+        size_t tab = args.find('\t');
+        if (tab == std::string_view::npos) return false;
+        Component* node = nodeAtPosition(root, args.substr(0, tab));
+        std::string_view rest = args.substr(tab + 1);
+        if (!node) return false;
+
+        if (kind == "REV") {
+            Money delta;
+            if (node->isGroup() || !Money::parse(rest, delta)) return false;
+            static_cast<Game*>(node)->addRevenue(delta);
+        } else if (kind == "GROUP") {
+            if (!node->isGroup()) return false;
+            static_cast<Group*>(node)->addGroup(rest);
+        } else if (kind == "GAME") {
+            size_t split = rest.rfind('\t');
+            Money revenue;
+            if (!node->isGroup() || split == std::string_view::npos || !Money::parse(rest.substr(split + 1), revenue)) {
+                return false;
+            }
+            static_cast<Group*>(node)->addGame(rest.substr(0, split), revenue);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Keeps one tree in sync with "<path>" and "<path>.journal". save() appends
+// only what changed since the previous save or load and compacts into a
+// fresh snapshot once the journal reaches half the snapshot's size.
+//
+// saveInBackground() does the same, but a snapshot it needs is written by a
+// worker thread from a flattened copy taken up front, so the tree can keep
+// changing while the file is written. The next call that touches the files
+// waits for that worker first.
+class ChangeJournal {
+private:
+    std::string snapshotPath;
+    std::string journalPath;
+    std::uint64_t token = 0; // 0: the files on disk do not describe `synced`
+    const Group* synced = nullptr;
+    std::thread writer;
+    std::atomic<bool> writeFailed{false};
+
+    static std::uint64_t newToken() {
+        std::random_device rd;
+        std::uint64_t t = (std::uint64_t(rd()) << 32) ^ rd();
+        t ^= std::uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+        return t ? t : 1;
+    }
+
+    static std::string hex(std::uint64_t value) {
+        char buf[16];
+        auto res = std::to_chars(buf, buf + sizeof(buf), value, 16);
+        return std::string(buf, res.ptr);
+    }
+
+    static std::uint64_t parseToken(std::string_view line, std::string_view tag) {
+        if (line.substr(0, tag.size()) != tag) return 0;
+        line.remove_prefix(tag.size());
+        std::uint64_t value = 0;
+        auto res = std::from_chars(line.data(), line.data() + line.size(), value, 16);
+        return res.ec == std::errc() && res.ptr == line.data() + line.size() ? value : 0;
+    }
+
+    static std::uintmax_t sizeOf(const std::string& path) {
+        std::error_code ec;
+        std::uintmax_t size = std::filesystem::file_size(path, ec);
+        return ec ? 0 : size;
+    }
+
+    // Replaces the snapshot through replaceFile() and starts an empty
+    // journal for it. A crash at any point leaves either the old snapshot or
+    // the new one, never a partial file.
+    template <class Root>
+    static bool writeSnapshot(const std::string& snapshotPath, const std::string& journalPath,
+                              Root&& root, std::uint64_t token) {
+        CASINO_TIMED(Save);
+        bool written = replaceFile(snapshotPath, [&](std::ostream& out) {
+            TextWriter writer(out);
+            root.save(writer, 0);
+            writer << "#JOURNAL " << hex(token) << '\n';
+            writer.flush();
+            return bool(out);
+        });
+        if (!written) return false;
+
+        std::ofstream journal(journalPath, std::ios::binary | std::ios::trunc);
+        journal << "SNAPSHOT " << hex(token) << '\n';
+        return bool(journal);
+    }
+
+    // True when the changes since the last save can go into the journal.
+    bool canAppend(Group& root) const {
+        if (!token || synced != &root) return false;
+        std::ifstream in(journalPath, std::ios::binary);
+        std::string first;
+        if (!in || !std::getline(in, first) || parseToken(first, "SNAPSHOT ") != token) return false;
+        return sizeOf(journalPath) * 2 <= sizeOf(snapshotPath);
+    }
+
+    bool append(Group& root) {
+        if (!root.isDirty()) return true;
+        CASINO_TIMED(JournalAppend);
+        std::ofstream out(journalPath, std::ios::binary | std::ios::app);
+        if (!out) return false;
+        TextWriter writer(out);
+        JournalWriter(writer).writeChanges(&root, std::string());
+        writer.flush();
+        return bool(out);
+    }
+
+public:
+    explicit ChangeJournal(std::string path)
+        : snapshotPath(std::move(path)), journalPath(snapshotPath + ".journal") {}
+
+    ~ChangeJournal() { wait(); }
+
+    ChangeJournal(const ChangeJournal&) = delete;
+    ChangeJournal& operator=(const ChangeJournal&) = delete;
+
+    const std::string& path() const { return snapshotPath; }
+
+    // Call when the tree is replaced by anything other than load().
+    void forget() {
+        wait();
+        token = 0;
+        synced = nullptr;
+    }
+
+    // Blocks until a background snapshot is on disk. Returns false if it
+    // could not be written; the next save is then a full one.
+    bool wait() {
+        if (writer.joinable()) writer.join();
+        if (!writeFailed.exchange(false)) return true;
+        token = 0;
+        synced = nullptr;
+        return false;
+    }
+
+    bool saveFull(Group& root) {
+        wait();
+        expandBeforeSave(&root);
+        std::uint64_t next = newToken();
+        if (!writeSnapshot(snapshotPath, journalPath, root, next)) {
+            token = 0;
+            synced = nullptr;
+            return false;
+        }
+        token = next;
+        synced = &root;
+        root.markPersisted();
+        return true;
+    }
+
+    // Appends the changes since the last save, or falls back to saveFull()
+    // when there is nothing to append to or the journal has grown too big.
+    bool save(Group& root) {
+        wait();
+        return canAppend(root) ? append(root) : saveFull(root);
+    }
+
+    // Like save(), but a full snapshot is written on a worker thread. The
+    // tree is treated as saved as of this call; if the write fails, wait()
+    // reports it and the next save rewrites everything.
+    bool saveInBackground(Group& root) {
+        wait();
+        if (canAppend(root)) return append(root);
+
+        std::uint64_t next = newToken();
+        expandBeforeSave(&root);
+        FlatTree frozen = FlatTree::fromComponent(&root);
+        token = next;
+        synced = &root;
+        root.markPersisted();
+        writer = std::thread([this, frozen = std::move(frozen), next]() mutable {
+            if (!writeSnapshot(snapshotPath, journalPath, frozen.root(), next)) writeFailed.store(true);
+        });
+        return true;
+    }
+
+    // True while a snapshot started by saveInBackground() has not been waited for.
+    bool saving() const { return writer.joinable(); }
+
+    // Loads the snapshot and replays its journal, if the journal matches.
+    // Returns nullptr, leaving both files alone, if a matching journal has a
+    // record that does not apply: saving over it would lose the records
+    // after it. An incomplete last line, as a crash during an append leaves,
+    // is dropped.
+    std::unique_ptr<Group> load() {
+        wait();
+        CASINO_TIMED(Load);
+        MappedFile file(snapshotPath);
+        if (!file.isOpen()) return nullptr;
+        std::string trailer;
+        auto loaded = parseParallel(file.view(), std::thread::hardware_concurrency(), &trailer);
+        std::uint64_t snapshotToken = parseToken(trailer, "#JOURNAL ");
+        if (!loaded || !loaded->isGroup()) return nullptr;
+        std::unique_ptr<Group> root(static_cast<Group*>(loaded.release()));
+        root->enableIndex();
+
+        token = 0;
+        synced = nullptr;
+        MappedFile journal(journalPath);
+        std::string_view records = journal.view();
+        size_t nl = records.find('\n');
+        std::string_view first = records.substr(0, nl);
+        if (!first.empty() && first.back() == '\r') first.remove_suffix(1);
+        if (snapshotToken && parseToken(first, "SNAPSHOT ") == snapshotToken && nl != std::string_view::npos) {
+            std::string_view body = records.substr(nl + 1);
+            size_t complete = body.rfind('\n') + 1; // npos + 1 == 0: no complete record
+            if (!replayJournal(*root, body.substr(0, complete))) return nullptr;
+            if (complete == body.size()) {
+                token = snapshotToken;
+                synced = root.get();
+            } // else the next save starts over rather than append after the torn line
+        }
+        root->markPersisted();
+        return root;
+    }
+};
+
+// === BINARY SNAPSHOTS ===
+// Layout (native byte order, little-endian on every supported target):
+//   SnapshotHeader
+//   uint32_t nameOffsets[nameCount + 1]   into the name blob
+//   char     names[nameBytes]             names back to back, no terminators
+//   padding to an 8-byte boundary
+//   SnapshotRecord records[nodeCount]     preorder, root first
+// A record's parent always precedes it, so the tree is rebuilt in one pass.
+// Version 1 stored revenue as a double in 24-byte records and a 64-bit
+// nameBytes; it is still read.
+constexpr char snapshotMagic[4] = {'C', 'S', 'N', 'P'};
+constexpr std::uint32_t snapshotVersion = 2;
+constexpr std::uint32_t snapshotNoParent = static_cast<std::uint32_t>(-1);
+constexpr std::uint32_t snapshotGroupFlag = 1u << 31; // in SnapshotRecord::name
+
+struct SnapshotHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t nodeCount;
+    std::uint32_t nameCount;
+    std::uint32_t nameBytes;
+    std::uint32_t moneyDigits; // Money::digits of the writer; 0 in version 1
+};
+static_assert(sizeof(SnapshotHeader) == 24);
+
+struct SnapshotRecord {
+    std::uint32_t parent;
+    std::uint32_t name;  // name id, snapshotGroupFlag set for groups
+    Money::Raw revenue;  // 0 for groups
+};
+static_assert(sizeof(SnapshotRecord) == 16);
+
+struct SnapshotRecordV1 {
+    std::uint32_t parent;
+    std::uint32_t name;
+    std::uint8_t isGroup;
+    std::uint8_t reserved[7];
+    double revenue;
+};
+static_assert(sizeof(SnapshotRecordV1) == 24);
+
+inline void collectSnapshot(Component* node, std::uint32_t parent, StringPool& names,
+                     std::vector<SnapshotRecord>& records) {
+    SnapshotRecord record{};
+    record.parent = parent;
+    auto index = static_cast<std::uint32_t>(records.size());
+    if (node->isGroup()) {
+        auto* group = static_cast<Group*>(node);
+        record.name = names.intern(group->getName()) | snapshotGroupFlag;
+        records.push_back(record);
+        for (Component* child : group->getChildren()) {
+            collectSnapshot(child, index, names, records);
+        }
+    } else {
+        auto* game = static_cast<Game*>(node);
+        record.name = names.intern(game->getName());
+        record.revenue = game->getRevenue().minorUnits();
+        records.push_back(record);
+    }
+}
+
+inline bool saveBinary(Component* root, const std::string& filename) {
+    CASINO_TIMED(Save);
+    expandBeforeSave(root);
+    StringPool names;
+    std::vector<SnapshotRecord> records;
+    collectSnapshot(root, snapshotNoParent, names, records);
+
+    std::vector<std::uint32_t> offsets;
+    offsets.reserve(names.size() + 1);
+    std::string blob;
+    for (std::uint32_t i = 0; i < names.size(); ++i) {
+        offsets.push_back(static_cast<std::uint32_t>(blob.size()));
+        blob += names.get(i);
+    }
+    offsets.push_back(static_cast<std::uint32_t>(blob.size()));
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+    header.version = snapshotVersion;
+    header.nodeCount = static_cast<std::uint32_t>(records.size());
+    header.nameCount = static_cast<std::uint32_t>(names.size());
+    header.nameBytes = static_cast<std::uint32_t>(blob.size());
+    header.moneyDigits = Money::digits;
+    if (names.size() >= snapshotGroupFlag || blob.size() > std::numeric_limits<std::uint32_t>::max()) return false;
+
+    size_t tableBytes = offsets.size() * sizeof(std::uint32_t) + blob.size();
+    blob.append((8 - (sizeof(header) + tableBytes) % 8) % 8, '\0');
+
+    return replaceFile(filename, [&](std::ostream& out) {
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(offsets.data()),
+                  static_cast<std::streamsize>(offsets.size() * sizeof(std::uint32_t)));
+        out.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+        out.write(reinterpret_cast<const char*>(records.data()),
+                  static_cast<std::streamsize>(records.size() * sizeof(SnapshotRecord)));
+        return static_cast<bool>(out);
+    });
+}
+
+// Returns nullptr for missing, truncated, foreign or newer-version files.
+inline std::unique_ptr<Component> loadBinary(const std::string& filename) {
+    CASINO_TIMED(Load);
+    MappedFile file(filename);
+    std::string_view data = file.view();
+    SnapshotHeader header;
+    if (data.size() < sizeof(header)) return nullptr;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0) return nullptr;
+    if (header.version == 0 || header.version > snapshotVersion || header.nodeCount == 0) return nullptr;
+    bool legacy = header.version == 1;
+    if (!legacy && header.moneyDigits != Money::digits) return nullptr;
+    size_t recordSize = legacy ? sizeof(SnapshotRecordV1) : sizeof(SnapshotRecord);
+
+    std::uint64_t offsetsBytes = (std::uint64_t(header.nameCount) + 1) * sizeof(std::uint32_t);
+    std::uint64_t tableEnd = sizeof(header) + offsetsBytes + header.nameBytes;
+    std::uint64_t recordsAt = (tableEnd + 7) / 8 * 8;
+    if (recordsAt + std::uint64_t(header.nodeCount) * recordSize > data.size()) return nullptr;
+
+    const char* offsetsAt = data.data() + sizeof(header);
+    const char* blob = offsetsAt + offsetsBytes;
+    auto nameOf = [&](std::uint32_t id, std::string_view& out) {
+        if (id >= header.nameCount) return false;
+        std::uint32_t range[2];
+        std::memcpy(range, offsetsAt + id * sizeof(std::uint32_t), sizeof(range));
+        if (range[0] > range[1] || range[1] > header.nameBytes) return false;
+        out = std::string_view(blob + range[0], range[1] - range[0]);
+        return true;
+    };
+
+    std::unique_ptr<Component> root;
+    std::vector<Group*> groups(header.nodeCount, nullptr);
+    std::string_view name;
+    for (std::uint32_t i = 0; i < header.nodeCount; ++i) {
+        const char* at = data.data() + recordsAt + i * recordSize;
+        SnapshotRecord record;
+        bool isGroup;
+        if (legacy) {
+            SnapshotRecordV1 old;
+            std::memcpy(&old, at, sizeof(old));
+            record.parent = old.parent;
+            record.name = old.name;
+            record.revenue = Money::fromDouble(old.revenue).minorUnits();
+            isGroup = old.isGroup != 0;
+        } else {
+            std::memcpy(&record, at, sizeof(record));
+            isGroup = (record.name & snapshotGroupFlag) != 0;
+            record.name &= ~snapshotGroupFlag;
+        }
+        if (!nameOf(record.name, name)) return nullptr;
+
+        bool isRoot = i == 0;
+        if (isRoot != (record.parent == snapshotNoParent)) return nullptr;
+        if (!isRoot && (record.parent >= i || !groups[record.parent])) return nullptr;
+
+        Money revenue = Money::fromUnits(record.revenue);
+        if (isRoot) {
+            if (isGroup) {
+                auto group = std::make_unique<Group>(name);
+                group->enablePool();
+                groups[i] = group.get();
+                root = std::move(group);
+            } else {
+                root = std::make_unique<Game>(name, revenue);
+            }
+        } else if (isGroup) {
+            groups[i] = groups[record.parent]->addGroup(name);
+        } else {
+            groups[record.parent]->addGame(name, revenue);
+        }
+    }
+    return root;
+}
+
+// === COMPRESSED ARCHIVES ===
+// For keeping years of snapshots. Layout:
+//   ArchiveHeader
+//   char base[baseNameBytes]   the base archive, relative to this file's
+//                              directory; empty for a full archive
+//   blocks, each: uint32_t rawBytes, uint32_t storedBytes, uint8_t method,
+//                 storedBytes of data; rawBytes == 0 ends the file
+// The blocks' raw bytes form one stream of LEB128 varints and names:
+//   nodeCount, then the nodes in preorder: ref << 1 | isGroup, followed by
+//   a group's child count or a game's zigzagged revenue delta
+// Names form a dictionary in order of first use. ref is 1 + the id of a name
+// seen before, or 0 for a new one, which follows the ref as the length it
+// shares with the previous new name, the length of the rest and the rest.
+// A game's delta is taken against the game at the same path in the base
+// archive (0 if there is none), so an archive of today against yesterday's
+// is mostly one-byte deltas. Blocks are deflated when built with zlib
+// (CASINO_ZLIB) and stored otherwise. loadArchive() inflates one block at a
+// time while it rebuilds the tree, so the raw stream is never held whole.
+constexpr char archiveMagic[4] = {'C', 'A', 'R', 'C'};
+constexpr std::uint32_t archiveVersion = 1;
+constexpr size_t archiveBlockSize = 1 << 18;
+constexpr size_t archiveMaxChain = 4096; // delta archives followed to a full one
+enum : std::uint8_t { archiveStored = 0, archiveDeflated = 1 };
+
+struct ArchiveHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t moneyDigits;
+    std::uint32_t baseNameBytes;
+    std::uint64_t baseFingerprint; // of the base file's bytes; 0 without a base
+};
+static_assert(sizeof(ArchiveHeader) == 24);
+
+// FNV-1a; ties a delta archive to the exact base it was written against.
+inline std::uint64_t archiveFingerprint(std::string_view bytes) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : bytes) hash = (hash ^ c) * 1099511628211ull;
+    return hash;
+}
+
+inline bool readWholeFile(const std::string& filename, std::string& out) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !in.bad();
+}
+
+class ArchiveWriter {
+private:
+    std::ostream& out;
+    std::string raw;
+    std::string packed;
+
+    void emit() {
+        std::uint8_t method = archiveStored;
+        std::string_view data = raw;
+#if CASINO_ZLIB
+        uLongf size = compressBound(uLong(raw.size()));
+        packed.resize(size);
+        if (compress2(reinterpret_cast<Bytef*>(packed.data()), &size, reinterpret_cast<const Bytef*>(raw.data()),
+                      uLong(raw.size()), Z_BEST_COMPRESSION) == Z_OK &&
+            size < raw.size()) {
+            method = archiveDeflated;
+            data = std::string_view(packed.data(), size);
+        }
+#endif
+        std::uint32_t sizes[2] = {std::uint32_t(raw.size()), std::uint32_t(data.size())};
+        out.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        out.put(char(method));
+        out.write(data.data(), std::streamsize(data.size()));
+        raw.clear();
+    }
+
+public:
+    explicit ArchiveWriter(std::ostream& o) : out(o) { raw.reserve(archiveBlockSize + 64); }
+
+    void varint(std::uint64_t value) {
+        while (value >= 0x80) {
+            raw.push_back(char(value | 0x80));
+            value >>= 7;
+        }
+        raw.push_back(char(value));
+        if (raw.size() >= archiveBlockSize) emit();
+    }
+
+    void bytes(std::string_view data) {
+        while (!data.empty()) {
+            size_t room = archiveBlockSize - raw.size();
+            raw.append(data.substr(0, room));
+            data.remove_prefix(std::min(room, data.size()));
+            if (raw.size() >= archiveBlockSize) emit();
+        }
+    }
+
+    bool finish() {
+        if (!raw.empty()) emit();
+        std::uint32_t end[2] = {0, 0};
+        out.write(reinterpret_cast<const char*>(end), sizeof(end));
+        out.put(char(archiveStored));
+        out.flush();
+        return static_cast<bool>(out);
+    }
+};
+
+// Pulls the raw stream out of an archive's blocks, one block at a time.
+class ArchiveReader {
+private:
+    std::istream& in;
+    std::string block;
+    std::string packed;
+    size_t pos = 0;
+    bool ended = false;
+
+    bool refill() {
+        if (ended) return false;
+        std::uint32_t sizes[2];
+        char method;
+        if (!in.read(reinterpret_cast<char*>(sizes), sizeof(sizes)) || !in.get(method)) return false;
+        if (sizes[0] == 0) {
+            ended = true;
+            return false;
+        }
+        if (sizes[0] > archiveBlockSize * 2 || sizes[1] > archiveBlockSize * 2) return false;
+        pos = 0;
+        if (method == archiveStored) {
+            if (sizes[0] != sizes[1]) return false;
+            block.resize(sizes[0]);
+            return bool(in.read(block.data(), std::streamsize(sizes[0])));
+        }
+#if CASINO_ZLIB
+        if (method == archiveDeflated) {
+            packed.resize(sizes[1]);
+            block.resize(sizes[0]);
+            if (!in.read(packed.data(), std::streamsize(sizes[1]))) return false;
+            uLongf size = sizes[0];
+            return uncompress(reinterpret_cast<Bytef*>(block.data()), &size,
+                              reinterpret_cast<const Bytef*>(packed.data()), sizes[1]) == Z_OK &&
+                   size == sizes[0];
+        }
+#endif
+        return false; // unknown method, or deflated and built without zlib
+    }
+
+public:
+    explicit ArchiveReader(std::istream& i) : in(i) {}
+
+    bool varint(std::uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos == block.size() && !refill()) return false;
+            auto byte = static_cast<unsigned char>(block[pos++]);
+            value |= std::uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool bytes(size_t count, std::string& out) {
+        while (count) {
+            if (pos == block.size() && !refill()) return false;
+            size_t take = std::min(count, block.size() - pos);
+            out.append(block, pos, take);
+            pos += take;
+            count -= take;
+        }
+        return true;
+    }
+};
+
+inline std::uint64_t zigzag(std::int64_t v) { return (std::uint64_t(v) << 1) ^ std::uint64_t(v >> 63); }
+inline std::int64_t unzigzag(std::uint64_t v) { return std::int64_t(v >> 1) ^ -std::int64_t(v & 1); }
+
+// Revenue of the game at `path` in a base tree, 0 if there is none.
+inline Money::Raw baseRevenue(Component* base, std::string_view path) {
+    if (!base) return 0;
+    if (!base->isGroup()) return path == static_cast<Game*>(base)->getName() ? base->getRevenue().minorUnits() : 0;
+    Game* game = static_cast<Group*>(base)->enableIndex()->findPath(path);
+    return game ? game->getRevenue().minorUnits() : 0;
+}
+
+struct ArchiveNames {
+    std::unordered_map<std::string_view, std::uint64_t> ids;
+    std::string_view previous; // last name added
+};
+
+inline void writeArchiveNode(ArchiveWriter& out, Component* node, Component* base, std::string& path,
+                             ArchiveNames& names) {
+    size_t before = path.size();
+    bool isGroup = node->isGroup();
+    std::string_view name = isGroup ? static_cast<Group*>(node)->getName() : static_cast<Game*>(node)->getName();
+    if (base) {
+        if (before) path += '/';
+        path += name;
+    }
+    auto [it, added] = names.ids.try_emplace(name, names.ids.size());
+    out.varint((added ? 0 : it->second + 1) << 1 | (isGroup ? 1 : 0));
+    if (added) {
+        size_t shared = 0;
+        while (shared < names.previous.size() && shared < name.size() && names.previous[shared] == name[shared])
+            ++shared;
+        out.varint(shared);
+        out.varint(name.size() - shared);
+        out.bytes(name.substr(shared));
+        names.previous = name;
+    }
+    if (isGroup) {
+        auto children = static_cast<Group*>(node)->getChildren();
+        out.varint(children.size());
+        for (Component* child : children) writeArchiveNode(out, child, base, path, names);
+    } else {
+        out.varint(zigzag(node->getRevenue().minorUnits() - baseRevenue(base, path)));
+    }
+    path.resize(before);
+}
+
+inline std::unique_ptr<Component> loadArchive(const std::string& filename, size_t chain = 0);
+
+// Writes `root` to `filename`, as deltas against the archive `baseFile` if
+// one is given. Keep every so many archives full (no base) so a load does
+// not have to follow a long chain.
+inline bool saveArchive(Component* root, const std::string& filename, const std::string& baseFile = "") {
+    CASINO_TIMED(Save);
+    expandBeforeSave(root);
+    namespace fs = std::filesystem;
+    std::unique_ptr<Component> base;
+    ArchiveHeader header{};
+    std::memcpy(header.magic, archiveMagic, sizeof(header.magic));
+    header.version = archiveVersion;
+    header.moneyDigits = Money::digits;
+    std::string baseName;
+    if (!baseFile.empty()) {
+        std::string baseBytes;
+        std::error_code same;
+        if (fs::equivalent(filename, baseFile, same)) return false; // would overwrite its own base
+        if (!readWholeFile(baseFile, baseBytes) || !(base = loadArchive(baseFile))) return false;
+        header.baseFingerprint = archiveFingerprint(baseBytes);
+        std::error_code error;
+        fs::path dir = fs::absolute(filename, error).parent_path();
+        baseName = fs::proximate(baseFile, dir, error).generic_string();
+        if (error) return false;
+        header.baseNameBytes = std::uint32_t(baseName.size());
+    }
+
+    return replaceFile(filename, [&](std::ostream& file) {
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(baseName.data(), std::streamsize(baseName.size()));
+
+        ArchiveWriter out(file);
+        std::uint64_t nodes = 0;
+        std::vector<Component*> stack{root};
+        while (!stack.empty()) {
+            Component* node = stack.back();
+            stack.pop_back();
+            ++nodes;
+            if (node->isGroup())
+                for (Component* child : static_cast<Group*>(node)->getChildren()) stack.push_back(child);
+        }
+        out.varint(nodes);
+        std::string path;
+        ArchiveNames names;
+        writeArchiveNode(out, root, base.get(), path, names);
+        return out.finish();
+    });
+}
+
+// Returns nullptr for missing, truncated or foreign archives, and for delta
+// archives whose base is missing or has changed since.
+inline std::unique_ptr<Component> loadArchive(const std::string& filename, size_t chain) {
+    CASINO_TIMED(Load);
+    namespace fs = std::filesystem;
+    std::ifstream file(filename, std::ios::binary);
+    ArchiveHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return nullptr;
+    if (std::memcmp(header.magic, archiveMagic, sizeof(header.magic)) != 0) return nullptr;
+    if (header.version != archiveVersion || header.moneyDigits != Money::digits) return nullptr;
+
+    std::unique_ptr<Component> base;
+    if (header.baseNameBytes) {
+        if (chain >= archiveMaxChain || header.baseNameBytes > 4096) return nullptr;
+        std::string baseName(header.baseNameBytes, '\0');
+        if (!file.read(baseName.data(), std::streamsize(baseName.size()))) return nullptr;
+        std::string basePath = (fs::path(filename).parent_path() / baseName).string();
+        std::string baseBytes;
+        if (!readWholeFile(basePath, baseBytes) || archiveFingerprint(baseBytes) != header.baseFingerprint)
+            return nullptr;
+        base = loadArchive(basePath, chain + 1);
+        if (!base) return nullptr;
+    }
+
+    ArchiveReader in(file);
+    std::uint64_t nodeCount;
+    if (!in.varint(nodeCount) || nodeCount == 0) return nullptr;
+    std::vector<std::string> names;
+
+    struct Open {
+        Group* group;
+        std::uint64_t remaining;
+        size_t pathLength;
+    };
+    std::vector<Open> open;
+    std::unique_ptr<Component> root;
+    std::string path;
+    for (std::uint64_t i = 0; i < nodeCount; ++i) {
+        while (!open.empty() && open.back().remaining == 0) {
+            path.resize(open.back().pathLength);
+            open.pop_back();
+        }
+        if (i > 0 && open.empty()) return nullptr; // more nodes than the tree holds
+        std::uint64_t tag, value;
+        if (!in.varint(tag)) return nullptr;
+        std::uint64_t ref = tag >> 1;
+        if (ref == 0) {
+            std::uint64_t shared, rest;
+            if (!in.varint(shared) || !in.varint(rest)) return nullptr;
+            if (shared > (names.empty() ? 0 : names.back().size()) || rest > archiveBlockSize * 64) return nullptr;
+            std::string fresh = names.empty() ? std::string() : names.back().substr(0, shared);
+            if (!in.bytes(rest, fresh)) return nullptr;
+            names.push_back(std::move(fresh));
+            ref = names.size();
+        }
+        if (ref > names.size() || !in.varint(value)) return nullptr;
+        const std::string& name = names[ref - 1];
+        bool isGroup = tag & 1;
+        size_t before = path.size();
+        if (base) {
+            if (before) path += '/';
+            path += name;
+        }
+        Group* parent = open.empty() ? nullptr : open.back().group;
+        if (parent) open.back().remaining--;
+
+        if (isGroup) {
+            Group* group;
+            if (parent) {
+                group = parent->addGroup(name);
+            } else {
+                auto made = std::make_unique<Group>(name);
+                made->enablePool();
+                group = made.get();
+                root = std::move(made);
+            }
+            open.push_back({group, value, before});
+        } else {
+            Money revenue = Money::fromUnits(baseRevenue(base.get(), path) + unzigzag(value));
+            if (parent) parent->addGame(name, revenue);
+            else root = std::make_unique<Game>(name, revenue);
+            path.resize(before);
+        }
+    }
+    for (const Open& o : open)
+        if (o.remaining) return nullptr;
+    return root;
+}
+
+// === BATCH INGESTION ===
+struct RevenueEvent {
+    std::string key; // full path or unique game name
+    Money amount;
+};
+
+struct BatchResult {
+    size_t applied = 0;
+    size_t unknown = 0;   // key not found or ambiguous
+    size_t malformed = 0; // stream lines that did not parse
+};
+
+// Collects revenue events, resolving each key through the root's index, and
+// applies them in commit(): every game is touched once and each group total
+// on the affected paths is updated once per batch, not once per event.
+class RevenueBatch {
+private:
+    GameIndex& index;
+    std::unordered_map<Game*, Money> perGame;
+    BatchResult result;
+public:
+    explicit RevenueBatch(GameIndex& idx) : index(idx) {}
+
+    bool add(std::string_view key, Money amount) { return add(index.find(key), amount); }
+
+    // Same, for a game already resolved through the index; nullptr counts
+    // as unknown.
+    bool add(Game* game, Money amount) {
+        if (!game) {
+            result.unknown++;
+            return false;
+        }
+        perGame[game] += amount;
+        result.applied++;
+        return true;
+    }
+
+    void reject() { result.malformed++; }
+    size_t pending() const { return perGame.size(); }
+
+    BatchResult commit() {
+        CASINO_TIMED(BatchCommit);
+        CASINO_COUNT(RevenueEvents, result.applied);
+        auto now = RevenueHistory::Clock::now();
+        std::unordered_map<Group*, Money> level;
+        for (auto& [game, delta] : perGame) {
+            game->revenue.fetch_add(delta.minorUnits(), std::memory_order_relaxed);
+            game->markDirty();
+            if (game->history) game->history->record(delta, now);
+            if (game->parent) level[game->parent] += delta;
+        }
+        // Every game here comes from the same index and so the same root.
+        Group* parent = perGame.empty() ? nullptr : perGame.begin()->first->parent;
+        if (GameRanking* r = parent ? parent->getRanking() : nullptr) {
+            std::vector<Game*> games;
+            games.reserve(perGame.size());
+            for (auto& entry : perGame) games.push_back(entry.first);
+            r->update(games);
+        }
+        perGame.clear();
+
+        // Walk the affected groups upward one level at a time, merging the
+        // deltas of siblings before they reach their common parent.
+        std::unordered_map<Group*, Money> next;
+        while (!level.empty()) {
+            for (auto& [group, delta] : level) {
+                group->total.add(delta);
+                if (group->history) group->history->record(delta, now);
+                if (group->parent) next[group->parent] += delta;
+            }
+            level.swap(next);
+            next.clear();
+        }
+
+        BatchResult done = result;
+        result = {};
+        return done;
+    }
+};
+
+inline BatchResult ingestRevenue(Group& root, std::span<const RevenueEvent> events) {
+    RevenueBatch batch(*root.enableIndex());
+    for (const auto& event : events) batch.add(event.key, event.amount);
+    return batch.commit();
+}
+
+// One event per line, "<key> <amount>", the amount being the last word.
+// Commits every `batchSize` lines so memory stays bounded on long streams.
+inline BatchResult ingestRevenue(Group& root, std::istream& in, size_t batchSize = 1 << 16) {
+    RevenueBatch batch(*root.enableIndex());
+    BatchResult total;
+    auto merge = [&total](const BatchResult& part) {
+        total.applied += part.applied;
+        total.unknown += part.unknown;
+        total.malformed += part.malformed;
+    };
+
+    std::string line;
+    std::string key;
+    size_t lines = 0;
+    while (std::getline(in, line)) {
+        std::string_view text = line;
+        if (!text.empty() && text.back() == '\r') text.remove_suffix(1);
+        if (text.empty()) continue;
+        Money amount;
+        if (parseGameArgs(text, key, amount)) batch.add(key, amount);
+        else batch.reject();
+        if (++lines % batchSize == 0) merge(batch.commit());
+    }
+    merge(batch.commit());
+    return total;
+}
+
+// === VERSIONED SNAPSHOTS ===
+// Immutable tree versions for readers that must see one consistent state
+// while updates keep coming. A writer never modifies a published node: it
+// copies the nodes on the paths it changes (each node at most once per
+// commit) and shares every untouched subtree with the previous version,
+// then publishes the new root. Readers pin a version with pin(), which only
+// holds a lock while copying one shared_ptr, and walk it without locks; a
+// version is freed when its last reader and
+// every later version sharing its nodes let go (reference counts).
+//
+// Each group keeps its children's positions sorted by kind and name, so a
+// path step is a binary search rather than a scan of a possibly huge group.
+// Copies of a group share that index until one of them gains a child.
+struct VersionNode {
+    struct Slot {
+        std::uint64_t key; // see slotKey()
+        std::uint32_t at;  // position in `children`
+        bool operator<(const Slot& other) const { return key != other.key ? key < other.key : at < other.at; }
+    };
+
+    Name name;
+    Money::Raw revenue = 0; // a game's own revenue, or a group's subtree total
+    bool group = false;
+    std::vector<std::shared_ptr<const VersionNode>> children;
+    std::shared_ptr<const std::vector<Slot>> slots; // one per child, ordered by (key, position)
+
+    static std::uint64_t slotKey(bool isGroup, Name n) { return std::uint64_t(isGroup) << 32 | n.handle(); }
+
+    bool isGroup() const { return group; }
+    std::string_view getName() const { return name.view(); }
+    Money getRevenue() const { return Money::fromUnits(revenue); }
+
+    void display(TextWriter& out, int indent = 0) const {
+        if (!group) {
+            out.indent(indent) << getName() << " | Revenue: " << getRevenue() << '\n';
+            return;
+        }
+        out.indent(indent) << "----- " << getName() << " -----" << '\n';
+        for (const auto& child : children) child->display(out, indent + 1);
+        out.indent(indent) << "Total: " << getRevenue() << '\n';
+    }
+
+    void save(TextWriter& out, int depth = 0) const {
+        if (!group) {
+            out.indent(depth) << "GAME " << getName() << ' ' << getRevenue() << '\n';
+            return;
+        }
+        out.indent(depth) << "GROUP " << getName() << '\n';
+        for (const auto& child : children) child->save(out, depth + 1);
+    }
+
+    // Rebuilds `slots` after `children` was filled in one go.
+    void indexChildren() {
+        auto sorted = std::make_shared<std::vector<Slot>>();
+        sorted->reserve(children.size());
+        for (size_t at = 0; at < children.size(); ++at) {
+            sorted->push_back({slotKey(children[at]->group, children[at]->name), std::uint32_t(at)});
+        }
+        std::sort(sorted->begin(), sorted->end());
+        slots = std::move(sorted);
+    }
+
+    // Appends `node` as the last child; its slot goes after every sibling
+    // of the same kind and name, as its position does.
+    void adopt(std::shared_ptr<const VersionNode> node) {
+        Slot slot{slotKey(node->group, node->name), std::uint32_t(children.size())};
+        auto grown = slots ? std::make_shared<std::vector<Slot>>(*slots) : std::make_shared<std::vector<Slot>>();
+        grown->insert(std::upper_bound(grown->begin(), grown->end(), slot), slot);
+        slots = std::move(grown);
+        children.push_back(std::move(node));
+    }
+
+    // Child named `n`, checking groups or games only; the first one wins.
+    const VersionNode* child(std::string_view n, bool wantGroup, size_t& at) const {
+        Name handle;
+        if (!slots || !Name::find(n, handle)) return nullptr;
+        Slot first{slotKey(wantGroup, handle), 0};
+        auto it = std::lower_bound(slots->begin(), slots->end(), first);
+        if (it == slots->end() || it->key != first.key) return nullptr;
+        at = it->at;
+        return children[at].get();
+    }
+
+    // The node at `path` ("Root/A/b", as in GameIndex) when this is the
+    // root, with the child positions leading to it in `route`; the last
+    // segment names a group or a game.
+    const VersionNode* find(std::string_view path, bool wantGroup, std::vector<size_t>& route) const {
+        route.clear();
+        size_t slash = path.find('/');
+        if (path.substr(0, slash) != getName()) return nullptr;
+        if (slash == std::string_view::npos) return wantGroup ? this : nullptr;
+        const VersionNode* node = this;
+        path.remove_prefix(slash + 1);
+        while (true) {
+            slash = path.find('/');
+            bool last = slash == std::string_view::npos;
+            size_t at;
+            node = node->child(path.substr(0, slash), last ? wantGroup : true, at);
+            if (!node) return nullptr;
+            route.push_back(at);
+            if (last) return node;
+            path.remove_prefix(slash + 1);
+        }
+    }
+
+    const VersionNode* find(std::string_view path, bool wantGroup) const {
+        std::vector<size_t> route;
+        return find(path, wantGroup, route);
+    }
+
+    // The node at child positions `route` below this one; nullptr if there
+    // is none.
+    const VersionNode* at(std::span<const std::uint32_t> route) const {
+        const VersionNode* node = this;
+        for (std::uint32_t i : route) {
+            if (!node->group || i >= node->children.size()) return nullptr;
+            node = node->children[i].get();
+        }
+        return node;
+    }
+};
+
+using VersionPtr = std::shared_ptr<const VersionNode>;
+
+class VersionedTree {
+public:
+    struct Version {
+        VersionPtr root;
+        std::uint64_t number = 0;
+    };
+
+    // Pending changes of one commit; see VersionedTree::update().
+    class Writer {
+    private:
+        friend class VersionedTree;
+        VersionPtr root;
+        std::unordered_set<const VersionNode*> fresh; // copied in this commit, still private
+        std::vector<size_t> route; // scratch for resolve()
+
+        explicit Writer(VersionPtr r) : root(std::move(r)) {}
+
+        VersionNode* own(VersionPtr& slot) {
+            if (fresh.count(slot.get())) return const_cast<VersionNode*>(slot.get()); // created non-const below
+            auto copy = std::make_shared<VersionNode>(*slot);
+            fresh.insert(copy.get());
+            slot = copy;
+            return copy.get();
+        }
+
+        // Child positions from the root down to the node at `path`.
+        bool resolve(std::string_view path, bool wantGroup, std::vector<size_t>& route) const {
+            return root->find(path, wantGroup, route) != nullptr;
+        }
+
+        // Copies the path to the end of `route`, adding `delta` to every
+        // total on it, and returns the node at its end.
+        template <class Route>
+        VersionNode* descend(const Route& route, Money::Raw delta) {
+            VersionNode* node = own(root);
+            node->revenue += delta;
+            for (size_t at : route) {
+                node = own(node->children[at]);
+                node->revenue += delta;
+            }
+            return node;
+        }
+
+    public:
+        bool addRevenue(std::string_view gamePath, Money amount) {
+            if (!resolve(gamePath, false, route)) return false;
+            descend(route, amount.minorUnits());
+            return true;
+        }
+
+        // The same for the game at child positions `route` from the root,
+        // as taken from the tree this version was copied from. Sibling
+        // names need not be unique. False if no game is there.
+        bool addRevenueAt(std::span<const std::uint32_t> route, Money amount) {
+            const VersionNode* node = root->at(route);
+            if (!node || node->group) return false;
+            descend(route, amount.minorUnits());
+            return true;
+        }
+
+        bool addGame(std::string_view groupPath, std::string_view n, Money revenue) {
+            if (!isStorableName(n) || !resolve(groupPath, true, route)) return false;
+            auto game = std::make_shared<VersionNode>();
+            game->name = Name(n);
+            game->revenue = revenue.minorUnits();
+            descend(route, revenue.minorUnits())->adopt(std::move(game));
+            return true;
+        }
+
+        bool addGroup(std::string_view parentPath, std::string_view n) {
+            if (!isStorableName(n) || !resolve(parentPath, true, route)) return false;
+            auto group = std::make_shared<VersionNode>();
+            group->name = Name(n);
+            group->group = true;
+            descend(route, 0)->adopt(std::move(group));
+            return true;
+        }
+    };
+
+private:
+    mutable std::mutex publishLock; // guards `current`, never held during a walk
+    VersionPtr current;
+    std::uint64_t number = 0;
+    std::mutex writerLock; // one writer at a time
+
+    static VersionPtr copyOf(Component* node) {
+        auto copy = std::make_shared<VersionNode>();
+        copy->revenue = node->getRevenue().minorUnits();
+        if (!node->isGroup()) {
+            copy->name = static_cast<Game*>(node)->getNameHandle();
+            return copy;
+        }
+        auto* group = static_cast<Group*>(node);
+        copy->name = group->getNameHandle();
+        copy->group = true;
+        auto children = group->getChildren();
+        copy->children.reserve(children.size());
+        for (Component* child : children) copy->children.push_back(copyOf(child));
+        copy->indexChildren();
+        return copy;
+    }
+
+public:
+    // Version 0 is a copy of `root`; the two are independent afterwards.
+    explicit VersionedTree(Group& root) : current(copyOf(&root)) {}
+
+    // Readers: the latest version, kept alive for as long as it is held.
+    Version pin() const {
+        std::lock_guard<std::mutex> lock(publishLock);
+        return {current, number};
+    }
+
+    std::uint64_t latest() const {
+        std::lock_guard<std::mutex> lock(publishLock);
+        return number;
+    }
+
+    // Runs `changes(Writer&)` against the latest version and publishes the
+    // result as the next one. Returns the new version number, or the
+    // current one if `changes` returned false (nothing is published).
+    template <class Changes>
+    std::uint64_t update(Changes&& changes) {
+        std::lock_guard<std::mutex> lock(writerLock);
+        Writer writer(pin().root);
+        if (!changes(writer)) return latest();
+        VersionPtr old;
+        std::lock_guard<std::mutex> publish(publishLock);
+        old.swap(current); // `old` dies after `publish`, so freeing a version never holds the lock
+        current = std::move(writer.root);
+        return ++number;
+    }
+
+    // Applies revenue events by full path as one new version.
+    BatchResult apply(std::span<const RevenueEvent> events) {
+        BatchResult result;
+        update([&](Writer& w) {
+            for (const auto& event : events) {
+                if (w.addRevenue(event.key, event.amount)) result.applied++;
+                else result.unknown++;
+            }
+            return result.applied > 0;
+        });
+        return result;
+    }
+};
+
+#endif // PROJEKTAS_CASINO_H
@@ -1,302 +1,521 @@
-#include <iostream>
-#include <vector>
-#include <string>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
-#include <sstream>
+#include <iostream>
 #include <memory>
+#include <string>
+#include <string_view>
 
-// === COMPONENT INTERFACE ===
-class Component {
-public:
-    virtual ~Component() = default;
-    virtual void display(int indent = 0) = 0;
-    virtual double getRevenue() = 0;
-    virtual void save(std::ofstream& out, int depth = 0) = 0;
-    virtual bool isGroup() = 0;
-};
-
-// === LEAF: GAME ===
-class Game : public Component {
-private:
-    std::string name;
-    double revenue;
-public:
-    Game(std::string n, double r) : name(n), revenue(r) {}
-
-    void display(int indent = 0) override {
-        for (int i = 0; i < indent; ++i) std::cout << "  ";
-        std::cout << name << " | Revenue: " << revenue << std::endl;
-    }
+#include "casino.h"
+#include "server.h"
 
-    double getRevenue() override { return revenue; }
+// === MAIN PROGRAM ===
+// Reads one amount token from the console; anything unparsable counts as 0.
+Money readMoney() {
+    std::string token;
+    std::cin >> token;
+    std::cin.ignore();
+    Money amount;
+    if (!Money::parse(token, amount)) amount = Money();
+    return amount;
+}
 
-    void save(std::ofstream& out, int depth = 0) override {
-        for (int i = 0; i < depth; ++i) out << "  ";
-        out << "GAME " << name << " " << revenue << std::endl;
+// Replaces `root` with the tree in the journal's file when there is one.
+// False if the file exists but cannot be loaded: carrying on with the sample
+// tree would later save it over that file.
+bool loadSaved(std::unique_ptr<Group>& root, ChangeJournal& journal) {
+    if (auto loaded = journal.load()) {
+        root = std::move(loaded);
+        return true;
     }
+    if (!std::filesystem::exists(journal.path())) return true;
+    std::cerr << "cannot load " << journal.path() << '\n';
+    return false;
+}
 
-    bool isGroup() override { return false; }
-
-    std::string getName() { return name; }
-    void addRevenue(double amount) { revenue += amount; }
+// === BATCH MODE ===
+// Runs against the journal's file (or the sample tree if there is none).
+// One command per line, blank lines and lines starting with '#' skipped:
+//   add-group <parent path>/<name>
+//   add-game <group path>/<name> <revenue>
+//   add-revenue <game path or unique name> <amount>
+//   save [file]      journaled save to casino.txt, or a full save to `file`
+//   load [file]
+//   total [path]     prints a group's or game's revenue
+//   history [path]   keeps revenue history for a group and everything below
+//   window <minutes> [path]  prints revenue added in the last <minutes>
+//   archive <file> [base]    compressed archive, as deltas against `base`
+//   load-archive <file>
+// Nothing is printed but errors (to stderr), `total` results and a final
+// summary. Consecutive add-revenue lines are applied as one RevenueBatch.
+struct BatchStats {
+    size_t commands = 0;
+    size_t failed = 0;
 };
 
-// === COMPOSITE: GROUP ===
-class Group : public Component {
-private:
-    std::string name;
-    std::vector<std::unique_ptr<Component>> children;
-public:
-    Group(std::string n) : name(n) {}
-
-    void add(std::unique_ptr<Component> component) {
-        children.push_back(std::move(component));
-    }
-
-    void display(int indent = 0) override {
-        for (int i = 0; i < indent; ++i) std::cout << "  ";
-        std::cout << "----- " << name << " -----" << std::endl;
-        for (auto& child : children) {
-            child->display(indent + 1);
-        }
-        for (int i = 0; i < indent; ++i) std::cout << "  ";
-        std::cout << "Total: " << getRevenue() << std::endl;
-    }
-
-    double getRevenue() override {
-        double total = 0.0;
-        for (auto& child : children) {
-            total += child->getRevenue();
-        }
-        return total;
-    }
-
-    void save(std::ofstream& out, int depth = 0) override {
-        for (int i = 0; i < depth; ++i) out << "  ";
-        out << "GROUP " << name << std::endl;
-        for (auto& child : children) {
-            child->save(out, depth + 1);
-        }
-    }
+bool splitLast(std::string_view text, char separator, std::string_view& head, std::string_view& tail) {
+    size_t at = text.rfind(separator);
+    if (at == std::string_view::npos || at == 0 || at + 1 == text.size()) return false;
+    head = text.substr(0, at);
+    tail = text.substr(at + 1);
+    return true;
+}
 
-    bool isGroup() override { return true; }
+int runBatch(std::istream& in, std::unique_ptr<Group>& root, ChangeJournal& journal) {
+    if (!loadSaved(root, journal)) return 1;
+    BatchStats stats;
+    auto batch = std::make_unique<RevenueBatch>(*root->enableIndex());
+    size_t lineNumber = 0;
+    auto fail = [&](std::string_view message) {
+        std::cerr << "line " << lineNumber << ": " << message << '\n';
+        stats.failed++;
+    };
 
-    std::string getName() { return name; }
-    std::vector<Component*> getChildren() {
-        std::vector<Component*> result;
-        for (auto& child : children) {
-            result.push_back(child.get());
+    std::string line;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        std::string_view text = line;
+        if (!text.empty() && text.back() == '\r') text.remove_suffix(1);
+        while (!text.empty() && isBlank(text.front())) text.remove_prefix(1);
+        if (text.empty() || text.front() == '#') continue;
+        stats.commands++;
+
+        size_t space = text.find(' ');
+        std::string_view command = text.substr(0, space);
+        std::string_view args = space == std::string_view::npos ? std::string_view() : text.substr(space + 1);
+        while (!args.empty() && isBlank(args.back())) args.remove_suffix(1);
+
+        if (command == "add-revenue") {
+            std::string key;
+            Money amount;
+            if (!parseGameArgs(args, key, amount)) fail("expected: add-revenue <game> <amount>");
+            else if (!batch->add(key, amount)) fail("no such game (or ambiguous name or path): " + key);
+            continue;
         }
-        return result;
-    }
-
-    std::vector<Game*> getAllGames() {
-        std::vector<Game*> games;
-        for (auto& child : children) {
-            if (child->isGroup()) {
-                auto subGames = static_cast<Group*>(child.get())->getAllGames();
-                games.insert(games.end(), subGames.begin(), subGames.end());
+        batch->commit();
+
+        GameIndex* index = root->getIndex();
+        // The root for an empty path, else a unique group or game path or name.
+        auto locate = [&](std::string_view path) -> Component* {
+            if (path.empty() || path == root->getName()) return root.get();
+            if (Group* group = index->findGroup(path)) return group;
+            return index->find(path);
+        };
+        if (command == "add-group") {
+            std::string_view parent, name;
+            Group* group = splitLast(args, '/', parent, name) ? index->findGroup(parent) : nullptr;
+            if (!group) fail("expected: add-group <existing, unique group path>/<name>");
+            else if (!group->addGroup(name)) fail("not a valid group name: " + std::string(name));
+        } else if (command == "add-game") {
+            std::string path;
+            Money revenue;
+            std::string_view parent, name;
+            Group* group = nullptr;
+            if (parseGameArgs(args, path, revenue) && splitLast(path, '/', parent, name)) group = index->findGroup(parent);
+            if (!group) fail("expected: add-game <existing, unique group path>/<name> <revenue>");
+            else if (!group->addGame(name, revenue)) fail("not a valid game name: " + std::string(name));
+        } else if (command == "save") {
+            if (args.empty()) {
+                if (!journal.save(*root)) fail("failed to save");
+                continue;
+            }
+            bool saved = replaceFile(std::string(args), [&](std::ostream& out) {
+                TextWriter writer(out);
+                root->save(writer);
+                writer.flush();
+                return bool(out);
+            });
+            if (!saved) fail("failed to save " + std::string(args));
+        } else if (command == "load") {
+            std::unique_ptr<Group> loaded;
+            if (args.empty()) {
+                loaded = journal.load();
             } else {
-                games.push_back(static_cast<Game*>(child.get()));
+                auto component = loadFromFileMapped(std::string(args));
+                if (component && component->isGroup()) loaded.reset(static_cast<Group*>(component.release()));
+                journal.forget();
+            }
+            if (!loaded) {
+                fail("failed to load");
+                continue;
             }
+            batch.reset();
+            root = std::move(loaded);
+            batch = std::make_unique<RevenueBatch>(*root->enableIndex());
+        } else if (command == "archive") {
+            std::string_view file = args.substr(0, args.find(' '));
+            std::string_view base = file.size() < args.size() ? args.substr(file.size() + 1) : std::string_view();
+            if (file.empty()) fail("expected: archive <file> [base]");
+            else if (!saveArchive(root.get(), std::string(file), std::string(base))) fail("failed to archive to " + std::string(file));
+        } else if (command == "load-archive") {
+            auto component = loadArchive(std::string(args));
+            if (!component || !component->isGroup()) {
+                fail("failed to load archive " + std::string(args));
+                continue;
+            }
+            batch.reset();
+            root.reset(static_cast<Group*>(component.release()));
+            journal.forget();
+            batch = std::make_unique<RevenueBatch>(*root->enableIndex());
+        } else if (command == "total") {
+            if (Component* node = locate(args)) std::cout << node->getRevenue() << '\n';
+            else fail("no such group or game: " + std::string(args));
+        } else if (command == "history") {
+            Group* group = args.empty() ? root.get() : index->findGroup(args);
+            if (!group) fail("expected: history [existing, unique group path]");
+            else group->enableHistory();
+        } else if (command == "window") {
+            size_t space = args.find(' ');
+            std::string_view count = args.substr(0, space);
+            std::string_view path = space == std::string_view::npos ? std::string_view() : args.substr(space + 1);
+            long minutes = 0;
+            Component* node = nullptr;
+            if (std::from_chars(count.data(), count.data() + count.size(), minutes).ptr == count.data() + count.size() &&
+                minutes > 0)
+                node = locate(path);
+            if (!node) fail("expected: window <minutes> [group or game path]");
+            else if (!node->hasHistory()) fail("no history kept for " + std::string(path) + ", see history");
+            else std::cout << node->revenueInLast(std::chrono::minutes(minutes)) << '\n';
+        } else {
+            fail("unknown command: " + std::string(command));
         }
-        return games;
-    }
-};
-
-// === FILE OPERATIONS ===
-int getDepth(const std::string& line) {
-    int depth = 0;
-    for (size_t i = 0; i + 1 < line.size() && line[i] == ' ' && line[i + 1] == ' '; i += 2) {
-        depth++;
     }
-    return depth;
-}
+    batch->commit();
+    if (!journal.wait()) fail("failed to save in the background");
 
-std::string trimSpaces(const std::string& line) {
-    size_t pos = 0;
-    while (pos + 1 < line.size() && line[pos] == ' ' && line[pos + 1] == ' ') {
-        pos += 2;
-    }
-    return line.substr(pos);
+    std::cout << "Executed " << stats.commands << " commands, " << stats.failed << " failed; "
+              << root->getGameCount() << " games, total revenue " << root->getRevenue() << std::endl;
+    return stats.failed == 0 ? 0 : 1;
 }
 
-std::unique_ptr<Component> parse(const std::vector<std::string>& lines, size_t& index) {
-    if (index >= lines.size()) return nullptr;
-
-    std::string line = lines[index];
-    if (line.empty()) {
-        index++;
-        return parse(lines, index);
-    }
+std::unique_ptr<Group> makeSampleTree() {
+    auto root = std::make_unique<Group>("Casino Games");
 
-    int currentDepth = getDepth(line);
-    std::string trimmed = trimSpaces(line);
+    // Initialize with sample data
+    auto tableGames = std::make_unique<Group>("Table Games");
+    tableGames->add(std::make_unique<Game>("Blackjack", Money()));
+    tableGames->add(std::make_unique<Game>("Roulette", Money()));
 
-    if (trimmed.substr(0, 6) == "GROUP ") {
-        std::string groupName = trimmed.substr(6);
-        auto group = std::make_unique<Group>(groupName);
-        index++;
+    auto slotGames = std::make_unique<Group>("Slot Games");
+    slotGames->add(std::make_unique<Game>("Mega Joker", Money()));
 
-        while (index < lines.size()) {
-            if (lines[index].empty()) {
-                index++;
-                continue;
-            }
+    root->add(std::move(tableGames));
+    root->add(std::move(slotGames));
+    root->enableIndex();
+    return root;
+}
 
-            int nextDepth = getDepth(lines[index]);
-            if (nextDepth <= currentDepth) break;
-            if (nextDepth == currentDepth + 1) {
-                auto child = parse(lines, index);
-                if (child) group->add(std::move(child));
-            } else {
-                index++;
-            }
+// === PAGED PICKER ===
+// Asks for a name prefix, then shows the matching groups or games from the
+// index a page at a time. Returns the one picked, or nullptr if the user
+// gives up. Only the rows on screen are formatted, however large the tree.
+template <class Node>
+Node* choosePaged(Group& root, const char* what) {
+    constexpr size_t pageSize = 20;
+    root.expandAll(); // lazily loaded groups are not in the index yet
+    GameIndex& index = *root.enableIndex();
+
+    std::cout << "Filter " << what << " by name prefix (empty for all): ";
+    std::string prefix;
+    std::getline(std::cin, prefix);
+
+    auto fetch = [&](size_t offset, size_t limit) {
+        if constexpr (std::is_same_v<Node, Game>) return index.listGames(prefix, offset, limit);
+        else return index.listGroups(prefix, offset, limit);
+    };
+
+    size_t offset = 0;
+    while (true) {
+        NamePage<Node> page = fetch(offset, pageSize);
+        if (page.matches == 0) {
+            std::cout << "No matching " << what << "!\n";
+            return nullptr;
         }
-        return group;
-    }
-    else if (trimmed.substr(0, 5) == "GAME ") {
-        std::istringstream iss(trimmed.substr(5));
-        std::vector<std::string> parts;
-        std::string part;
-        while (iss >> part) parts.push_back(part);
-
-        if (parts.size() >= 2) {
-            double revenue = std::stod(parts.back());
-            std::string gameName = parts[0];
-            for (size_t i = 1; i < parts.size() - 1; ++i) {
-                gameName += " " + parts[i];
+        {
+            TextWriter out(std::cout);
+            for (size_t i = 0; i < page.rows.size(); ++i) {
+                const NameEntry<Node>& row = page.rows[i];
+                out << std::to_string(offset + i + 1) << ". " << row.path;
+                if (row.copies > 1) out << " [" << std::to_string(row.ordinal) << " of " << std::to_string(row.copies) << ']';
+                if constexpr (std::is_same_v<Node, Game>) out << " (Revenue: " << row.node->getRevenue() << ')';
+                out << '\n';
             }
-            index++;
-            return std::make_unique<Game>(gameName, revenue);
         }
+        std::cout << "Showing " << offset + 1 << '-' << offset + page.rows.size() << " of " << page.matches
+                  << ". Number to select, n/p for next/previous page, empty to cancel: ";
+        std::string answer;
+        if (!std::getline(std::cin, answer) || answer.empty()) return nullptr;
+        if (answer == "n") {
+            if (offset + pageSize < page.matches) offset += pageSize;
+            continue;
+        }
+        if (answer == "p") {
+            offset = offset >= pageSize ? offset - pageSize : 0;
+            continue;
+        }
+        size_t number = std::strtoul(answer.c_str(), nullptr, 10);
+        if (number > 0 && number <= page.matches) return fetch(number - 1, 1).rows.front().node;
+        std::cout << "No such entry!\n";
     }
-
-    index++;
-    return nullptr;
 }
 
-std::unique_ptr<Component> loadFromFile(const std::string& filename) {
-    std::ifstream in(filename);
-    if (!in) return nullptr;
+// === SERVER MODE ===
+volatile std::sig_atomic_t stopRequested = 0;
 
-    std::vector<std::string> lines;
-    std::string line;
-    while (std::getline(in, line)) {
-        lines.push_back(line);
-    }
+void requestStop(int) { stopRequested = 1; }
 
-    size_t index = 0;
-    return parse(lines, index);
+void printStats(const LineServer::Stats& stats) {
+    std::cout << "Served " << stats.connections.load() << " connections: " << stats.events.load() << " events, "
+              << stats.rejected.load() << " rejected, " << stats.queries.load() << " queries" << std::endl;
 }
 
-void saveToFile(Component* root, const std::string& filename) {
-    std::ofstream out(filename);
-    if (out) {
-        root->save(out, 0);
-        std::cout << "Saved to: " << filename << std::endl;
+// Serves the journal's file (or the sample tree if there is none) until
+// SIGINT or SIGTERM, then saves.
+int runServer(std::uint16_t port, std::unique_ptr<Group>& root, ChangeJournal& journal) {
+    if (!loadSaved(root, journal)) return 1;
+    RevenueServer server(*root);
+    if (!server.start(port)) {
+        std::cerr << "cannot listen on port " << port << '\n';
+        return 1;
+    }
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    std::cout << "Listening on port " << server.port() << std::endl;
+    while (!stopRequested) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    server.stop();
+
+    printStats(server.stats());
+    if (!journal.save(*root)) {
+        std::cerr << "failed to save\n";
+        return 1;
     }
+    return 0;
 }
 
-// === MAIN PROGRAM ===
-int main() {
-    auto root = std::make_unique<Group>("Casino Games");
-
-    // Initialize with sample data
-    auto tableGames = std::make_unique<Group>("Table Games");
-    tableGames->add(std::make_unique<Game>("Blackjack", 0));
-    tableGames->add(std::make_unique<Game>("Roulette", 0));
+// Fronts the shard servers at `shards` until SIGINT or SIGTERM. The
+// coordinator holds no tree of its own, so there is nothing to save.
+int runCoordinator(std::uint16_t port, const std::vector<std::string>& shards) {
+    ShardCoordinator coordinator(shards);
+    if (!coordinator.start(port)) {
+        std::cerr << "cannot reach the shards, they disagree on ownership, or port " << port << " is taken\n";
+        return 1;
+    }
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    std::cout << "Coordinating " << coordinator.getShardCount() << " shards (" << coordinator.getOwnedCount()
+              << " top-level entries under " << coordinator.getRootName() << ") on port " << coordinator.port()
+              << std::endl;
+    while (!stopRequested) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    coordinator.stop();
+    printStats(coordinator.stats());
+    return 0;
+}
 
-    auto slotGames = std::make_unique<Group>("Slot Games");
-    slotGames->add(std::make_unique<Game>("Mega Joker", 0));
+// Usage: projektas                        interactive menu
+//        projektas --exec FILE            run batch commands from FILE ("-" for stdin)
+//        projektas --serve PORT [TREE]    accept revenue events over TCP (see
+//                                         server.h); TREE defaults to casino.txt
+//        projektas --coordinate PORT HOST:PORT...
+//                                         front shard servers, each serving its
+//                                         own top-level groups
+int main(int argc, char** argv) {
+    bool exec = argc == 3 && std::strcmp(argv[1], "--exec") == 0;
+    bool serve = (argc == 3 || argc == 4) && std::strcmp(argv[1], "--serve") == 0;
+    bool coordinate = argc >= 4 && std::strcmp(argv[1], "--coordinate") == 0;
+    if (argc > 1 && !exec && !serve && !coordinate) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--exec FILE|- | --serve PORT [TREE] | --coordinate PORT HOST:PORT...]\n";
+        return 2;
+    }
 
-    root->add(std::move(tableGames));
-    root->add(std::move(slotGames));
+    auto root = makeSampleTree();
+    const std::string filename = serve && argc == 4 ? argv[3] : "casino.txt";
+    const std::string snapshotFile = "casino.snap";
+    ChangeJournal journal(filename);
+
+    if (argc > 1) {
+        auto port = static_cast<std::uint16_t>(std::strtoul(argv[2], nullptr, 10));
+        if (serve) return runServer(port, root, journal);
+        if (coordinate) return runCoordinator(port, std::vector<std::string>(argv + 3, argv + argc));
+        if (std::strcmp(argv[2], "-") == 0) return runBatch(std::cin, root, journal);
+        std::ifstream commands(argv[2]);
+        if (!commands) {
+            std::cerr << "cannot open " << argv[2] << '\n';
+            return 2;
+        }
+        return runBatch(commands, root, journal);
+    }
 
-    const std::string filename = "casino.txt";
     int choice;
 
     while (true) {
-        std::cout << "\n1. Display games\n2. Add game\n3. Add revenue\n4. Save\n5. Load\n0. Exit\n";
+        std::cout << "\n1. Display games\n2. Add game\n3. Add revenue\n4. Save\n5. Load\n6. Save snapshot\n7. Load snapshot\n8. Add revenue by name\n9. Import revenue batch\n10. Dump metrics\n11. Save archive\n12. Load archive\n0. Exit\n";
         std::cin >> choice;
         std::cin.ignore();
 
-        if (choice == 0) break;
+        if (choice == 0) {
+            if (!journal.wait()) std::cout << "Failed to save file!\n";
+            break;
+        }
 
         switch (choice) {
-            case 1:
-                root->display();
+            case 1: {
+                TextWriter out(std::cout);
+                root->display(out);
                 break;
+            }
 
             case 2: {
-                auto children = static_cast<Group*>(root.get())->getChildren();
-                std::cout << "Groups:\n";
-                for (size_t i = 0; i < children.size(); ++i) {
-                    if (children[i]->isGroup()) {
-                        std::cout << i + 1 << ". " << static_cast<Group*>(children[i])->getName() << std::endl;
-                    }
-                }
-
-                std::cout << "Select group: ";
-                size_t groupIndex;
-                std::cin >> groupIndex;
-                std::cin.ignore();
-
-                if (groupIndex > 0 && groupIndex <= children.size() && children[groupIndex - 1]->isGroup()) {
+                Group* group = choosePaged<Group>(*root, "groups");
+                if (group) {
                     std::cout << "Game name: ";
                     std::string gameName;
                     std::getline(std::cin, gameName);
+                    if (!isStorableName(gameName)) {
+                        std::cout << "A game needs a name.\n";
+                        break;
+                    }
 
                     std::cout << "Revenue: ";
-                    double revenue;
-                    std::cin >> revenue;
-                    std::cin.ignore();
+                    Money revenue = readMoney();
 
-                    static_cast<Group*>(children[groupIndex - 1])->add(std::make_unique<Game>(gameName, revenue));
+                    group->add(std::make_unique<Game>(gameName, revenue));
                     std::cout << "Game added!\n";
                 }
                 break;
             }
 
             case 3: {
-                auto games = static_cast<Group*>(root.get())->getAllGames();
-                std::cout << "Games:\n";
-                for (size_t i = 0; i < games.size(); ++i) {
-                    std::cout << i + 1 << ". " << games[i]->getName() << " (Revenue: " << games[i]->getRevenue() << ")\n";
-                }
-
-                std::cout << "Select game: ";
-                size_t gameIndex;
-                std::cin >> gameIndex;
-                std::cin.ignore();
-
-                if (gameIndex > 0 && gameIndex <= games.size()) {
+                Game* game = choosePaged<Game>(*root, "games");
+                if (game) {
                     std::cout << "Add revenue: ";
-                    double addRevenue;
-                    std::cin >> addRevenue;
-                    std::cin.ignore();
+                    Money addRevenue = readMoney();
 
-                    games[gameIndex - 1]->addRevenue(addRevenue);
+                    game->addRevenue(addRevenue);
                     std::cout << "Revenue added!\n";
                 }
                 break;
             }
 
             case 4:
-                saveToFile(root.get(), filename);
+                if (journal.saveInBackground(*root)) {
+                    if (journal.saving()) std::cout << "Saving to: " << filename << " in the background" << std::endl;
+                    else std::cout << "Saved to: " << filename << std::endl;
+                } else {
+                    std::cout << "Failed to save file!\n";
+                }
                 break;
 
             case 5: {
-                auto loaded = loadFromFile(filename);
-                if (loaded && loaded->isGroup()) {
-                    root.reset(static_cast<Group*>(loaded.release()));
+                auto loaded = journal.load();
+                if (loaded) {
+                    root = std::move(loaded);
                     std::cout << "Loaded from: " << filename << std::endl;
-                    root->display();
+                    TextWriter out(std::cout);
+                    root->display(out);
                 } else {
                     std::cout << "Failed to load file!\n";
                 }
                 break;
             }
+
+            case 6:
+                if (saveBinary(root.get(), snapshotFile)) {
+                    std::cout << "Saved to: " << snapshotFile << std::endl;
+                } else {
+                    std::cout << "Failed to save snapshot!\n";
+                }
+                break;
+
+            case 7: {
+                auto loaded = loadBinary(snapshotFile);
+                if (loaded && loaded->isGroup()) {
+                    root.reset(static_cast<Group*>(loaded.release()));
+                    root->enableIndex();
+                    journal.forget();
+                    std::cout << "Loaded from: " << snapshotFile << std::endl;
+                    TextWriter out(std::cout);
+                    root->display(out);
+                } else {
+                    std::cout << "Failed to load snapshot!\n";
+                }
+                break;
+            }
+
+            case 8: {
+                std::cout << "Game (path or name): ";
+                std::string key;
+                std::getline(std::cin, key);
+
+                GameIndex* index = root->getIndex();
+                Game* game = index->find(key);
+                if (!game) {
+                    size_t matches = std::max(index->pathCount(key), index->findName(key).size());
+                    if (matches > 1) std::cout << matches << " games share that name or path, pick one with option 3.\n";
+                    else std::cout << "No such game!\n";
+                    break;
+                }
+
+                std::cout << "Add revenue: ";
+                Money addRevenue = readMoney();
+
+                game->addRevenue(addRevenue);
+                std::cout << "Revenue added!\n";
+                break;
+            }
+
+            case 9: {
+                std::cout << "Batch file: ";
+                std::string batchFile;
+                std::getline(std::cin, batchFile);
+
+                std::ifstream in(batchFile);
+                if (!in) {
+                    std::cout << "Failed to open batch file!\n";
+                    break;
+                }
+                BatchResult result = ingestRevenue(*root, in);
+                std::cout << "Applied: " << result.applied << ", unknown: " << result.unknown
+                          << ", malformed: " << result.malformed << std::endl;
+                break;
+            }
+
+            case 10:
+                Metrics::writePrometheus(std::cout);
+                break;
+
+            case 11: {
+                std::cout << "Archive file: ";
+                std::string archiveFile;
+                std::getline(std::cin, archiveFile);
+                std::cout << "Base archive (empty for a full one): ";
+                std::string baseFile;
+                std::getline(std::cin, baseFile);
+
+                if (saveArchive(root.get(), archiveFile, baseFile)) std::cout << "Saved to: " << archiveFile << std::endl;
+                else std::cout << "Failed to save archive!\n";
+                break;
+            }
+
+            case 12: {
+                std::cout << "Archive file: ";
+                std::string archiveFile;
+                std::getline(std::cin, archiveFile);
+
+                auto loaded = loadArchive(archiveFile);
+                if (loaded && loaded->isGroup()) {
+                    root.reset(static_cast<Group*>(loaded.release()));
+                    root->enableIndex();
+                    journal.forget();
+                    std::cout << "Loaded from: " << archiveFile << std::endl;
+                } else {
+                    std::cout << "Failed to load archive!\n";
+                }
+                break;
+            }
         }
     }
 
@@ -0,0 +1,989 @@
+#ifndef PROJEKTAS_SERVER_H
+#define PROJEKTAS_SERVER_H
+
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "casino.h"
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+// === LINE SERVER ===
+// TCP plumbing shared by the servers below: one request per line ("\n" or
+// "\r\n"), answered in order on the same connection. One acceptor thread
+// hands connections round-robin to a few worker threads, each with its own
+// epoll set and its own Handler. A worker passes every complete line it read
+// from a connection in one go to handle(), calls finish() once per wakeup and
+// only then sends the replies. Linux only (epoll).
+//
+// Derived classes must call stop() in their destructor, before the state
+// their handlers use goes away.
+class LineServer {
+public:
+    struct Stats {
+        std::atomic<std::uint64_t> events{0};
+        std::atomic<std::uint64_t> rejected{0};
+        std::atomic<std::uint64_t> queries{0};
+        std::atomic<std::uint64_t> connections{0};
+    };
+
+protected:
+    // Per-worker request handling; only ever used from its worker's thread.
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        // Appends one reply line per line in `lines`, in order. Work may be
+        // held back until finish().
+        virtual void handle(const std::vector<std::string_view>& lines, std::string& reply) = 0;
+        virtual void finish() {}
+    };
+
+    virtual std::unique_ptr<Handler> makeHandler() = 0;
+
+    Stats counters;
+
+    static void appendMoney(std::string& out, Money amount) {
+        char digits[Money::maxFormatted];
+        out.append(digits, amount.format(digits));
+    }
+
+private:
+#ifdef __linux__
+    struct Connection {
+        std::string in;   // unparsed bytes
+        std::string out;  // replies not written yet
+        bool waitingToWrite = false;
+    };
+
+    struct Worker {
+        int poll = -1;
+        int wake = -1; // eventfd: new connections or stop
+        std::mutex mutex;
+        std::vector<int> incoming; // accepted, not yet registered
+        std::thread thread;
+    };
+
+    unsigned workerCount;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::thread acceptor;
+    int listener = -1;
+    int acceptWake = -1;
+    std::uint16_t boundPort = 0;
+    std::atomic<bool> stopping{false};
+
+    static void closeFd(int& fd) {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    static void signal(int eventFd) {
+        std::uint64_t one = 1;
+        [[maybe_unused]] ssize_t n = ::write(eventFd, &one, sizeof(one));
+    }
+
+    void acceptLoop() {
+        int poll = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = listener;
+        epoll_ctl(poll, EPOLL_CTL_ADD, listener, &ev);
+        ev.data.fd = acceptWake;
+        epoll_ctl(poll, EPOLL_CTL_ADD, acceptWake, &ev);
+
+        size_t next = 0;
+        epoll_event ready[2];
+        while (!stopping.load()) {
+            if (epoll_wait(poll, ready, 2, -1) <= 0) continue;
+            while (true) {
+                int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) break;
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                Worker& w = *workers[next++ % workers.size()];
+                {
+                    std::lock_guard<std::mutex> lock(w.mutex);
+                    w.incoming.push_back(fd);
+                }
+                signal(w.wake);
+                counters.connections.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        ::close(poll);
+    }
+
+    // Writes what it can; returns false if the peer is gone.
+    static bool flush(int fd, Connection& c) {
+        while (!c.out.empty()) {
+            ssize_t n = ::send(fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+            if (n > 0) {
+                c.out.erase(0, size_t(n));
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        return true;
+    }
+
+    void workLoop(Worker& w) {
+        std::unique_ptr<Handler> handler = makeHandler();
+        std::unordered_map<int, Connection> connections;
+        std::vector<int> touched;
+        std::vector<std::string_view> lines;
+        std::vector<epoll_event> ready(64);
+        char buffer[1 << 16];
+
+        auto drop = [&](int fd) {
+            epoll_ctl(w.poll, EPOLL_CTL_DEL, fd, nullptr);
+            ::close(fd);
+            connections.erase(fd);
+        };
+
+        while (!stopping.load()) {
+            int n = epoll_wait(w.poll, ready.data(), int(ready.size()), -1);
+            touched.clear();
+            for (int i = 0; i < n; ++i) {
+                int fd = ready[i].data.fd;
+                if (fd == w.wake) {
+                    std::uint64_t count;
+                    [[maybe_unused]] ssize_t r = ::read(w.wake, &count, sizeof(count));
+                    std::vector<int> fresh;
+                    {
+                        std::lock_guard<std::mutex> lock(w.mutex);
+                        fresh.swap(w.incoming);
+                    }
+                    for (int c : fresh) {
+                        epoll_event ev{};
+                        ev.events = EPOLLIN | EPOLLRDHUP;
+                        ev.data.fd = c;
+                        epoll_ctl(w.poll, EPOLL_CTL_ADD, c, &ev);
+                        connections.emplace(c, Connection{});
+                    }
+                    continue;
+                }
+
+                auto it = connections.find(fd);
+                if (it == connections.end()) continue;
+                Connection& c = it->second;
+                bool closed = (ready[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+                if (ready[i].events & EPOLLIN) {
+                    while (true) {
+                        ssize_t got = ::recv(fd, buffer, sizeof(buffer), 0);
+                        if (got > 0) {
+                            c.in.append(buffer, size_t(got));
+                            continue;
+                        }
+                        if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) closed = true;
+                        if (got < 0 && errno == EINTR) continue;
+                        break;
+                    }
+                    lines.clear();
+                    size_t pos = 0;
+                    for (size_t nl; (nl = c.in.find('\n', pos)) != std::string::npos; pos = nl + 1) {
+                        std::string_view line(c.in.data() + pos, nl - pos);
+                        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                        if (!line.empty()) lines.push_back(line);
+                    }
+                    if (!lines.empty()) handler->handle(lines, c.out);
+                    c.in.erase(0, pos);
+                }
+                if (closed) {
+                    // The peer may only have shut down its sending side.
+                    handler->finish();
+                    flush(fd, c);
+                    drop(fd);
+                    continue;
+                }
+                touched.push_back(fd);
+            }
+
+            handler->finish();
+            for (int fd : touched) {
+                auto it = connections.find(fd);
+                if (it == connections.end()) continue;
+                Connection& c = it->second;
+                if (!flush(fd, c)) {
+                    drop(fd);
+                    continue;
+                }
+                bool waiting = !c.out.empty();
+                if (waiting != c.waitingToWrite) {
+                    epoll_event ev{};
+                    ev.events = EPOLLIN | EPOLLRDHUP | (waiting ? EPOLLOUT : 0u);
+                    ev.data.fd = fd;
+                    epoll_ctl(w.poll, EPOLL_CTL_MOD, fd, &ev);
+                    c.waitingToWrite = waiting;
+                }
+            }
+        }
+        for (auto& [fd, c] : connections) ::close(fd);
+    }
+#endif
+
+public:
+#ifdef __linux__
+    explicit LineServer(unsigned threads) : workerCount(threads ? threads : 1) {}
+#else
+    explicit LineServer(unsigned) {}
+#endif
+
+    virtual ~LineServer() { stop(); }
+
+    LineServer(const LineServer&) = delete;
+    LineServer& operator=(const LineServer&) = delete;
+
+    // Listens on `port` (0 picks a free one, see port()) on all interfaces.
+    // Returns false if the socket cannot be set up or the platform has no
+    // server support.
+    bool start(std::uint16_t port) {
+#ifdef __linux__
+        if (listener >= 0) return false;
+        listener = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listener < 0) return false;
+        int on = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        socklen_t length = sizeof(addr);
+        if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listener, SOMAXCONN) != 0 ||
+            getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+            closeFd(listener);
+            return false;
+        }
+        boundPort = ntohs(addr.sin_port);
+
+        stopping.store(false);
+        acceptWake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        for (unsigned i = 0; i < workerCount; ++i) {
+            auto w = std::make_unique<Worker>();
+            w->poll = epoll_create1(EPOLL_CLOEXEC);
+            w->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = w->wake;
+            epoll_ctl(w->poll, EPOLL_CTL_ADD, w->wake, &ev);
+            workers.push_back(std::move(w));
+        }
+        for (auto& w : workers) {
+            Worker* worker = w.get();
+            w->thread = std::thread([this, worker] { workLoop(*worker); });
+        }
+        acceptor = std::thread([this] { acceptLoop(); });
+        return true;
+#else
+        (void)port;
+        return false;
+#endif
+    }
+
+    std::uint16_t port() const {
+#ifdef __linux__
+        return boundPort;
+#else
+        return 0;
+#endif
+    }
+
+    // Stops accepting, closes every connection and joins the threads.
+    void stop() {
+#ifdef __linux__
+        if (listener < 0) return;
+        stopping.store(true);
+        signal(acceptWake);
+        if (acceptor.joinable()) acceptor.join();
+        for (auto& w : workers) {
+            signal(w->wake);
+            if (w->thread.joinable()) w->thread.join();
+            closeFd(w->poll);
+            closeFd(w->wake);
+        }
+        workers.clear();
+        closeFd(acceptWake);
+        closeFd(listener);
+#endif
+    }
+
+    const Stats& stats() const { return counters; }
+};
+
+// === INGEST SERVER ===
+// Serves one tree:
+//   REV <game path or unique name>\t<amount>   -> "OK" or "ERR <reason>"
+//   TOTAL <group or game path>                 -> "<amount>" or "ERR <reason>"
+//   TOP <k>\t<group path>                      -> "TOP <n>" followed by n
+//                                                 "\t<amount>\t<game path>"
+//                                                 pairs, best first
+//   OWNED                                      -> "OWNED <root>" followed by
+//                                                 "\t<name>" per top-level child
+//   REPORT <group path>                        -> "REPORT <version>\t<total>"
+//                                                 followed by "\t<amount>\t<name>"
+//                                                 per child
+// A worker resolves every REV it reads in one wakeup, commits them as one
+// RevenueBatch and only then sends the OKs, so an acknowledged event is in the
+// totals, and a TOTAL or TOP sees every REV sent before it on its connection.
+//
+// TOTAL and TOP read the live tree, which other workers update while they
+// walk it. REPORT reads a pinned VersionedTree version instead, so its totals
+// always add up and a long report never holds up ingestion. Versions are made
+// on demand: a worker commit only adds its per-game deltas to its worker's
+// tally, and a REPORT first publishes every tally as one new version. Deltas
+// reach the version by the games' child positions, so duplicate names and
+// paths land on the same node as in the live tree.
+//
+// The tree's shape must not change while the server runs; revenue updates
+// from elsewhere (menu, other threads) are fine but only REVs reach REPORT.
+class RevenueServer : public LineServer {
+private:
+    // Deltas committed by one worker and not yet in a version.
+    struct Tally {
+        std::mutex mutex;
+        std::unordered_map<Game*, Money> deltas;
+    };
+
+    Group& root;
+    GameIndex& index;
+    // Set up in start(), once lazy groups are expanded.
+    std::unique_ptr<VersionedTree> versions;
+    std::unordered_map<const Component*, std::vector<std::uint32_t>> routes; // child positions from the root
+    std::vector<std::unique_ptr<Tally>> tallies; // one per worker
+    std::atomic<size_t> nextTally{0};
+    std::mutex publishing; // one REPORT publishes at a time
+    bool outOfStep = false; // a delta had no route; guarded by `publishing`
+
+    class IngestHandler : public Handler {
+    private:
+        RevenueServer& server;
+        RevenueBatch batch;
+        Tally& tally;
+        std::vector<std::pair<Game*, Money>> queued; // the batch's REVs
+
+    public:
+        explicit IngestHandler(RevenueServer& owner)
+            : server(owner), batch(owner.index),
+              tally(*owner.tallies[owner.nextTally.fetch_add(1) % owner.tallies.size()]) {}
+
+        void handle(const std::vector<std::string_view>& lines, std::string& reply) override {
+            for (std::string_view line : lines) server.answer(line, *this, reply);
+        }
+
+        void finish() override { commit(); }
+
+        // Queues one REV; false if `key` resolves to no game or several.
+        bool queue(std::string_view key, Money amount) {
+            Game* game = server.index.find(key);
+            if (!batch.add(game, amount)) return false;
+            queued.emplace_back(game, amount);
+            return true;
+        }
+
+        bool pending() const { return batch.pending() != 0; }
+
+        // Applies the queued REVs to the tree and notes them for the next
+        // version.
+        void commit() {
+            batch.commit();
+            if (queued.empty()) return;
+            std::lock_guard<std::mutex> lock(tally.mutex);
+            for (auto& [game, amount] : queued) tally.deltas[game] += amount;
+            queued.clear();
+        }
+    };
+
+    void mapRoutes(Component* node, std::vector<std::uint32_t>& route) {
+        routes.emplace(node, route);
+        if (!node->isGroup()) return;
+        auto children = static_cast<Group*>(node)->getChildren();
+        for (size_t i = 0; i < children.size(); ++i) {
+            route.push_back(std::uint32_t(i));
+            mapRoutes(children[i], route);
+            route.pop_back();
+        }
+    }
+
+    // Publishes every worker's tally as one version and pins the result.
+    // False if a delta could not be placed, which only a change to the
+    // tree's shape can cause; every later report fails too.
+    bool publish(VersionedTree::Version& version) {
+        std::lock_guard<std::mutex> lock(publishing);
+        std::vector<std::unordered_map<Game*, Money>> taken;
+        for (auto& t : tallies) {
+            std::lock_guard<std::mutex> hold(t->mutex);
+            if (!t->deltas.empty()) taken.push_back(std::exchange(t->deltas, {}));
+        }
+        if (!taken.empty()) {
+            versions->update([&](VersionedTree::Writer& w) {
+                for (auto& deltas : taken) {
+                    for (auto& [game, amount] : deltas) {
+                        auto route = routes.find(game);
+                        if (route == routes.end() || !w.addRevenueAt(route->second, amount)) outOfStep = true;
+                    }
+                }
+                return true;
+            });
+        }
+        version = versions->pin();
+        return !outOfStep;
+    }
+
+    std::unique_ptr<Handler> makeHandler() override { return std::make_unique<IngestHandler>(*this); }
+
+    // Handles one request line, appending its reply. REVs are only queued in
+    // `handler`; the caller commits before sending anything.
+    void answer(std::string_view line, IngestHandler& handler, std::string& reply) {
+        if (line.substr(0, 4) == "REV ") {
+            std::string_view args = line.substr(4);
+            size_t tab = args.rfind('\t');
+            Money amount;
+            if (tab == std::string_view::npos || !Money::parse(args.substr(tab + 1), amount)) {
+                reply += "ERR malformed\n";
+                counters.rejected.fetch_add(1, std::memory_order_relaxed);
+            } else if (!handler.queue(args.substr(0, tab), amount)) {
+                reply += "ERR unknown game\n";
+                counters.rejected.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                reply += "OK\n";
+                counters.events.fetch_add(1, std::memory_order_relaxed);
+            }
+            return;
+        }
+        if (line.substr(0, 6) == "TOTAL ") {
+            std::string_view path = line.substr(6);
+            if (handler.pending()) handler.commit();
+            counters.queries.fetch_add(1, std::memory_order_relaxed);
+            Money total;
+            if (Group* group = index.findGroup(path)) total = group->getRevenue();
+            else if (Game* game = index.find(path)) total = game->getRevenue();
+            else {
+                reply += "ERR unknown path\n";
+                return;
+            }
+            appendMoney(reply, total);
+            reply += '\n';
+            return;
+        }
+        if (line.substr(0, 4) == "TOP ") {
+            std::string_view args = line.substr(4);
+            size_t tab = args.find('\t');
+            size_t k = 0;
+            if (tab == std::string_view::npos ||
+                std::from_chars(args.data(), args.data() + tab, k).ptr != args.data() + tab) {
+                reply += "ERR malformed\n";
+                return;
+            }
+            if (handler.pending()) handler.commit();
+            counters.queries.fetch_add(1, std::memory_order_relaxed);
+            Group* group = index.findGroup(args.substr(tab + 1));
+            if (!group) {
+                reply += "ERR unknown path\n";
+                return;
+            }
+            std::vector<Game*> best = topK(*group, k);
+            reply += "TOP ";
+            reply += std::to_string(best.size());
+            for (Game* game : best) {
+                reply += '\t';
+                appendMoney(reply, game->getRevenue());
+                reply += '\t';
+                reply += game->getParent()->getPath();
+                reply += '/';
+                reply += game->getName();
+            }
+            reply += '\n';
+            return;
+        }
+        if (line == "OWNED") {
+            reply += "OWNED ";
+            reply += root.getName();
+            for (Component* child : root.getChildren()) {
+                reply += '\t';
+                reply += child->isGroup() ? static_cast<Group*>(child)->getName()
+                                          : static_cast<Game*>(child)->getName();
+            }
+            reply += '\n';
+            return;
+        }
+        if (line.substr(0, 7) == "REPORT ") {
+            if (handler.pending()) handler.commit();
+            counters.queries.fetch_add(1, std::memory_order_relaxed);
+            VersionedTree::Version version;
+            if (!publish(version)) {
+                reply += "ERR report out of step with the tree\n";
+                return;
+            }
+            Group* live = index.findGroup(line.substr(7));
+            const VersionNode* group = live ? version.root->at(routes.at(live)) : nullptr;
+            if (!group) {
+                reply += "ERR unknown path\n";
+                return;
+            }
+            reply += "REPORT ";
+            reply += std::to_string(version.number);
+            reply += '\t';
+            appendMoney(reply, group->getRevenue());
+            for (const VersionPtr& child : group->children) {
+                reply += '\t';
+                appendMoney(reply, child->getRevenue());
+                reply += '\t';
+                reply += child->getName();
+            }
+            reply += '\n';
+            return;
+        }
+        reply += "ERR unknown command\n";
+    }
+
+public:
+    explicit RevenueServer(Group& tree, unsigned threads = 4)
+        : LineServer(threads), root(tree), index(*tree.enableIndex()) {
+        for (unsigned i = 0; i < std::max(threads, 1u); ++i) tallies.push_back(std::make_unique<Tally>());
+    }
+
+    ~RevenueServer() override { stop(); }
+
+    bool start(std::uint16_t port) {
+        root.expandAll(); // lazy groups would otherwise expand under the workers' feet
+        versions = std::make_unique<VersionedTree>(root);
+        routes.clear();
+        std::vector<std::uint32_t> route;
+        mapRoutes(&root, route);
+        for (auto& t : tallies) t->deltas.clear();
+        outOfStep = false;
+        return LineServer::start(port);
+    }
+};
+
+// === SHARD COORDINATOR ===
+// Fronts several RevenueServers ("shards") that each hold a tree with the
+// same root name but different top-level children, e.g. one property per
+// process. Clients speak the ingest protocol to the coordinator as if it were
+// one server:
+//   - REV, and TOTAL/TOP/REPORT below the root, go to the shard owning the
+//     path's top-level child; REV needs a full path, unique names are not
+//     routable.
+//   - TOTAL, TOP and REPORT on the root go to every shard; the coordinator
+//     adds the totals and merges the per-shard top-k lists (each shard's k
+//     best hold the global k best). A root REPORT carries the sum of the
+//     shards' version numbers, so it still grows whenever any shard
+//     publishes, and lists every shard's children in shard order; each
+//     shard's part is consistent on its own, not across shards.
+// A worker forwards all lines it read from a connection with one write per
+// shard and then collects the replies, so shards work in parallel and a
+// batch costs one round trip rather than one per event. Ordering per client
+// connection is kept because each worker has its own shard connections.
+//
+// Ownership is learnt with OWNED when start() is called; it fails if a shard
+// is unreachable, the roots differ or two shards claim the same child.
+class ShardCoordinator : public LineServer {
+private:
+    struct Endpoint {
+        std::string host;
+        std::string port;
+    };
+
+    // Blocking client connection to one shard.
+    class ShardLink {
+    private:
+        const Endpoint* endpoint = nullptr;
+#ifdef __linux__
+        int fd = -1;
+#endif
+        std::string in;
+
+    public:
+        ShardLink() = default;
+        explicit ShardLink(const Endpoint& e) : endpoint(&e) {}
+        ShardLink(ShardLink&& other) noexcept : endpoint(other.endpoint), in(std::move(other.in)) {
+#ifdef __linux__
+            fd = other.fd;
+            other.fd = -1;
+#endif
+        }
+        ShardLink& operator=(ShardLink&&) = delete;
+        ~ShardLink() { close(); }
+
+        void close() {
+#ifdef __linux__
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+#endif
+            in.clear();
+        }
+
+        bool open() {
+#ifdef __linux__
+            if (fd >= 0) return true;
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* found = nullptr;
+            if (getaddrinfo(endpoint->host.c_str(), endpoint->port.c_str(), &hints, &found) != 0) return false;
+            for (addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+                fd = ::socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+                if (fd < 0) continue;
+                if (::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+                    ::close(fd);
+                    fd = -1;
+                }
+            }
+            freeaddrinfo(found);
+            if (fd < 0) return false;
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            timeval limit{5, 0}; // a stuck shard must not hang the worker for good
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof(limit));
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        bool send(std::string_view data) {
+#ifdef __linux__
+            while (!data.empty()) {
+                ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                data.remove_prefix(size_t(n));
+            }
+            return true;
+#else
+            (void)data;
+            return false;
+#endif
+        }
+
+        // Next reply line without its terminator.
+        bool readLine(std::string& line) {
+#ifdef __linux__
+            char buffer[1 << 16];
+            size_t nl;
+            while ((nl = in.find('\n')) == std::string::npos) {
+                ssize_t got = ::recv(fd, buffer, sizeof(buffer), 0);
+                if (got < 0 && errno == EINTR) continue;
+                if (got <= 0) return false;
+                in.append(buffer, size_t(got));
+            }
+            line.assign(in, 0, nl);
+            in.erase(0, nl + 1);
+            return true;
+#else
+            (void)line;
+            return false;
+#endif
+        }
+    };
+
+    // One question and its answer(s), so replies can be put back in order.
+    struct Pending {
+        enum Kind { Local, One, Sum, Top, Report } kind = Local;
+        size_t shard = 0;  // One
+        size_t k = 0;      // Top
+        std::string text;  // Local
+        bool isRev = false;
+    };
+
+    class ForwardHandler : public Handler {
+    private:
+        ShardCoordinator& coordinator;
+        std::vector<ShardLink> links;
+        std::vector<std::string> outgoing;
+        std::vector<std::vector<std::string>> answers;
+        std::vector<Pending> pending;
+
+    public:
+        explicit ForwardHandler(ShardCoordinator& owner)
+            : coordinator(owner), outgoing(owner.shards.size()), answers(owner.shards.size()) {
+            links.reserve(owner.shards.size());
+            for (const Endpoint& e : owner.shards) links.emplace_back(e);
+        }
+
+        void handle(const std::vector<std::string_view>& lines, std::string& reply) override {
+            size_t shardCount = links.size();
+            pending.clear();
+            for (size_t s = 0; s < shardCount; ++s) {
+                outgoing[s].clear();
+                answers[s].clear();
+            }
+            for (std::string_view line : lines) pending.push_back(coordinator.route(line, outgoing));
+
+            // Send everything before reading anything, so the shards overlap.
+            std::vector<size_t> expected(shardCount, 0);
+            for (const Pending& p : pending) {
+                if (p.kind == Pending::One) ++expected[p.shard];
+                else if (p.kind != Pending::Local)
+                    for (size_t s = 0; s < shardCount; ++s) ++expected[s];
+            }
+            std::vector<bool> sent(shardCount, false);
+            for (size_t s = 0; s < shardCount; ++s) {
+                if (!expected[s]) continue;
+                sent[s] = links[s].open() && links[s].send(outgoing[s]);
+                if (!sent[s]) links[s].close();
+            }
+            for (size_t s = 0; s < shardCount; ++s) {
+                std::string line;
+                for (size_t i = 0; i < expected[s]; ++i) {
+                    if (sent[s] && !links[s].readLine(line)) {
+                        sent[s] = false;
+                        links[s].close(); // replies after this point are lost; reconnect next time
+                    }
+                    answers[s].push_back(sent[s] ? line : "ERR shard unavailable");
+                }
+            }
+
+            std::vector<size_t> cursor(shardCount, 0);
+            for (const Pending& p : pending) {
+                switch (p.kind) {
+                    case Pending::Local:
+                        reply += p.text;
+                        break;
+                    case Pending::One: {
+                        const std::string& answer = answers[p.shard][cursor[p.shard]++];
+                        if (p.isRev)
+                            (answer == "OK" ? coordinator.counters.events : coordinator.counters.rejected)
+                                .fetch_add(1, std::memory_order_relaxed);
+                        reply += answer;
+                        break;
+                    }
+                    case Pending::Sum:
+                        sum(cursor, reply);
+                        break;
+                    case Pending::Top:
+                        merge(cursor, p.k, reply);
+                        break;
+                    case Pending::Report:
+                        combine(cursor, reply);
+                        break;
+                }
+                reply += '\n';
+            }
+        }
+
+    private:
+        void sum(std::vector<size_t>& cursor, std::string& reply) {
+            Money total;
+            for (size_t s = 0; s < links.size(); ++s) {
+                const std::string& answer = answers[s][cursor[s]++];
+                Money part;
+                if (!Money::parse(answer, part)) {
+                    for (size_t rest = s + 1; rest < links.size(); ++rest) ++cursor[rest];
+                    reply += answer; // a partial total would look like a real one
+                    return;
+                }
+                total += part;
+            }
+            appendMoney(reply, total);
+        }
+
+        void merge(std::vector<size_t>& cursor, size_t k, std::string& reply) {
+            TopK<std::string_view> best(k);
+            for (size_t s = 0; s < links.size(); ++s) {
+                std::string_view answer = answers[s][cursor[s]++];
+                if (answer.substr(0, 4) != "TOP ") {
+                    for (size_t rest = s + 1; rest < links.size(); ++rest) ++cursor[rest];
+                    reply += answer;
+                    return;
+                }
+                // "TOP n" then "\t<amount>\t<path>" pairs; offer each pair as
+                // its path so it can be copied to the reply as is.
+                size_t pos = answer.find('\t');
+                while (pos != std::string_view::npos) {
+                    size_t split = answer.find('\t', pos + 1);
+                    if (split == std::string_view::npos) break;
+                    size_t end = answer.find('\t', split + 1);
+                    Money amount;
+                    Money::parse(answer.substr(pos + 1, split - pos - 1), amount);
+                    best.offer(amount.minorUnits(), answer.substr(pos, end == std::string_view::npos ? end : end - pos));
+                    pos = end;
+                }
+            }
+            std::vector<std::string_view> merged = best.take();
+            reply += "TOP ";
+            reply += std::to_string(merged.size());
+            for (std::string_view entry : merged) reply += entry;
+        }
+
+        // "REPORT <version>\t<total>" then "\t<amount>\t<name>" per child
+        // from every shard: versions and totals add up, children follow each
+        // other in shard order.
+        void combine(std::vector<size_t>& cursor, std::string& reply) {
+            std::uint64_t version = 0;
+            Money total;
+            std::string children;
+            for (size_t s = 0; s < links.size(); ++s) {
+                std::string_view answer = answers[s][cursor[s]++];
+                std::string_view fields = answer.substr(std::min<size_t>(7, answer.size()));
+                size_t tab = fields.find('\t');
+                size_t end = tab == std::string_view::npos ? tab : fields.find('\t', tab + 1);
+                std::uint64_t number = 0;
+                Money part;
+                if (answer.substr(0, 7) != "REPORT " || tab == std::string_view::npos ||
+                    std::from_chars(fields.data(), fields.data() + tab, number).ptr != fields.data() + tab ||
+                    !Money::parse(fields.substr(tab + 1, end == std::string_view::npos ? end : end - tab - 1), part)) {
+                    for (size_t rest = s + 1; rest < links.size(); ++rest) ++cursor[rest];
+                    reply += answer; // a partial report would look like a real one
+                    return;
+                }
+                version += number;
+                total += part;
+                if (end != std::string_view::npos) children += fields.substr(end);
+            }
+            reply += "REPORT ";
+            reply += std::to_string(version);
+            reply += '\t';
+            appendMoney(reply, total);
+            reply += children;
+        }
+    };
+
+    std::vector<Endpoint> shards;
+    std::string rootName;
+    std::map<std::string, size_t, std::less<>> owners; // top-level child -> shard
+
+    std::unique_ptr<Handler> makeHandler() override { return std::make_unique<ForwardHandler>(*this); }
+
+    // The shard owning `path`, or shards.size() if none does. "Root" alone
+    // has no owner.
+    size_t ownerOf(std::string_view path) const {
+        if (path.size() <= rootName.size() || path.substr(0, rootName.size()) != rootName ||
+            path[rootName.size()] != '/')
+            return shards.size();
+        std::string_view child = path.substr(rootName.size() + 1);
+        child = child.substr(0, child.find('/'));
+        auto it = owners.find(child);
+        return it == owners.end() ? shards.size() : it->second;
+    }
+
+    // Queues `line` for the shard(s) that can answer it, or answers it here.
+    Pending route(std::string_view line, std::vector<std::string>& outgoing) {
+        Pending p;
+        auto forward = [&](size_t shard) {
+            outgoing[shard].append(line.data(), line.size());
+            outgoing[shard] += '\n';
+        };
+        auto everywhere = [&](Pending::Kind kind) {
+            for (size_t s = 0; s < shards.size(); ++s) forward(s);
+            p.kind = kind;
+        };
+
+        std::string_view path;
+        bool rev = line.substr(0, 4) == "REV ";
+        bool total = line.substr(0, 6) == "TOTAL ";
+        bool top = line.substr(0, 4) == "TOP ";
+        bool report = line.substr(0, 7) == "REPORT ";
+        if (rev) {
+            std::string_view args = line.substr(4);
+            path = args.substr(0, args.rfind('\t'));
+        } else if (total) {
+            path = line.substr(6);
+        } else if (top) {
+            std::string_view args = line.substr(4);
+            size_t tab = args.find('\t');
+            size_t k = 0;
+            if (tab == std::string_view::npos ||
+                std::from_chars(args.data(), args.data() + tab, k).ptr != args.data() + tab) {
+                p.text = "ERR malformed";
+                return p;
+            }
+            p.k = k;
+            path = args.substr(tab + 1);
+        } else if (report) {
+            path = line.substr(7);
+        } else if (line == "OWNED") {
+            p.text = "OWNED " + rootName;
+            for (const auto& [child, shard] : owners) p.text += '\t' + child;
+            return p;
+        } else {
+            p.text = "ERR unknown command";
+            return p;
+        }
+
+        if (!rev) counters.queries.fetch_add(1, std::memory_order_relaxed);
+        if (!rev && path == rootName) {
+            everywhere(total ? Pending::Sum : top ? Pending::Top : Pending::Report);
+            return p;
+        }
+        size_t shard = ownerOf(path);
+        if (shard == shards.size()) {
+            if (rev) counters.rejected.fetch_add(1, std::memory_order_relaxed);
+            p.text = rev ? "ERR unknown game" : "ERR unknown path";
+            return p;
+        }
+        forward(shard);
+        p.kind = Pending::One;
+        p.shard = shard;
+        p.isRev = rev;
+        return p;
+    }
+
+    // Asks every shard what it owns.
+    bool discover() {
+        owners.clear();
+        rootName.clear();
+        for (size_t s = 0; s < shards.size(); ++s) {
+            ShardLink link(shards[s]);
+            std::string answer;
+            if (!link.open() || !link.send("OWNED\n") || !link.readLine(answer) || answer.substr(0, 6) != "OWNED ")
+                return false;
+            std::string_view rest = std::string_view(answer).substr(6);
+            size_t tab = rest.find('\t');
+            std::string_view root = rest.substr(0, tab);
+            if (s == 0) rootName = root;
+            else if (root != rootName) return false;
+            while (tab != std::string_view::npos) {
+                rest = rest.substr(tab + 1);
+                tab = rest.find('\t');
+                if (!owners.emplace(std::string(rest.substr(0, tab)), s).second) return false;
+            }
+        }
+        return !shards.empty();
+    }
+
+public:
+    // `addresses` are "host:port" strings, one per shard.
+    explicit ShardCoordinator(const std::vector<std::string>& addresses, unsigned threads = 4)
+        : LineServer(threads) {
+        for (const std::string& a : addresses) {
+            size_t colon = a.rfind(':');
+            if (colon == std::string::npos) shards.push_back({a, ""});
+            else shards.push_back({a.substr(0, colon), a.substr(colon + 1)});
+        }
+    }
+
+    ~ShardCoordinator() override { stop(); }
+
+    bool start(std::uint16_t port) {
+        return discover() && LineServer::start(port);
+    }
+
+    const std::string& getRootName() const { return rootName; }
+    size_t getShardCount() const { return shards.size(); }
+    size_t getOwnedCount() const { return owners.size(); }
+};
+
+#endif // PROJEKTAS_SERVER_H